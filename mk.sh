@@ -9,16 +9,36 @@ CWARN="-Wall -Wextra -Wno-missing-field-initializers"
 
 run_mixer()
 {
-  gcc $CWARN -Os -fsanitize=undefined -o mixer src/mixer.c src/canonwav.c
+  gcc $CWARN -Os -fsanitize=undefined -o mixer src/mixer_main.c src/mixer.c src/wavecache.c src/pitchtable.c src/canonwav.c -lm
   ./mixer
   paplay out.wav
 }
 
+run_bench()
+{
+  gcc $CWARN -O2 -pthread -o bench src/bench_main.c src/allocator.c src/gaplist.c src/hashmap.c src/frozenmap.c src/interntable.c src/pcmring.c src/chunklist.c
+  ./bench
+}
+
 run_parser()
 {
   gperf --output-file=build/ftkeywords.c src/ftkeywords.gperf
-  gcc $CWARN -Os -fsanitize=address -o ftparse src/ftparse_main.c src/ftparse.c src/ftmodule.c src/gaplist.c build/ftkeywords.c
+  gcc $CWARN -Os -fsanitize=address -o ftparse src/ftparse_main.c src/ftparse.c src/ftmodule.c src/ftevents.c src/ftmetronome.c src/ftenvelope.c src/ftwavebank.c src/gaplist.c src/hashmap.c src/allocator.c build/ftkeywords.c
   ./ftparse
 }
 
+run_player()
+{
+  gperf --output-file=build/ftkeywords.c src/ftkeywords.gperf
+  gcc $CWARN -Os -fsanitize=address -o ftplay src/ftplay_main.c src/ftplayer.c src/ftsegcache.c src/fteffects.c src/ftparse.c src/ftmodule.c src/ftevents.c src/ftmetronome.c src/ftenvelope.c src/ftwavebank.c src/gaplist.c src/hashmap.c src/allocator.c src/mixer.c src/wavecache.c src/pitchtable.c src/canonwav.c build/ftkeywords.c -lm
+  ./ftplay
+}
+
+run_stream()
+{
+  gperf --output-file=build/ftkeywords.c src/ftkeywords.gperf
+  gcc $CWARN -O2 -pthread -o ftstream src/ftstream_main.c src/ftplayer.c src/ftsegcache.c src/fteffects.c src/ftparse.c src/ftmodule.c src/ftevents.c src/ftmetronome.c src/ftenvelope.c src/ftwavebank.c src/gaplist.c src/hashmap.c src/allocator.c src/mixer.c src/wavecache.c src/pitchtable.c src/pcmring.c build/ftkeywords.c -lm
+  ./ftstream parsertest.txt - 256 48000 | pacat --raw --format=s16le --rate=48000 --channels=1
+}
+
 run_parser
@@ -0,0 +1,153 @@
+/*
+the default allocator and a bump allocator
+*/
+#include "allocator.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t roundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Returns the bytes to skip after p to reach a multiple of alignment.
+ */
+static size_t padding(const unsigned char *p, size_t alignment) {
+  return -(uintptr_t)p & (alignment - 1);
+}
+
+// libc /////////////////////////////////////////////////////////////
+
+static void *libc_alloc(void *ctx, size_t size, size_t alignment) {
+  (void)ctx;
+  if (!alignment) return malloc(size ? size : 1);
+  return aligned_alloc(alignment, size ? roundUp(size, alignment) : alignment);
+}
+
+static void *libc_realloc(void *ctx, void *ptr, size_t oldSize,
+                          size_t newSize) {
+  (void)ctx;
+  (void)oldSize;
+  return realloc(ptr, newSize ? newSize : 1);
+}
+
+static void libc_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+const Allocator Allocator_libc = {
+  libc_alloc, libc_realloc, libc_free, NULL
+};
+
+// Arena ////////////////////////////////////////////////////////////
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *prev;
+  size_t size;  // bytes in data
+  alignas(max_align_t) unsigned char data[];
+} ArenaChunk;
+
+struct Arena {
+  Allocator allocator;
+  ArenaChunk *chunk;  // the chunk being carved, or NULL
+  size_t used;  // bytes of chunk->data already allocated
+  size_t chunkSize;
+  unsigned char *last;  // most recent block, which can grow or shrink
+};
+
+static void *arena_alloc(void *ctx, size_t size, size_t alignment) {
+  Arena *self = ctx;
+  if (alignment < alignof(max_align_t)) alignment = alignof(max_align_t);
+
+  // The data is aligned only to max_align_t, so align the address
+  // rather than the offset
+  size_t start = self->chunk
+                 ? self->used + padding(self->chunk->data + self->used,
+                                        alignment)
+                 : 0;
+  if (!self->chunk || start > self->chunk->size
+      || size > self->chunk->size - start) {
+    // Start a new chunk; the rest of this one is wasted.  The extra
+    // alignment bytes leave room for the padding.
+    size_t dataSize = size + alignment > self->chunkSize
+                      ? size + alignment : self->chunkSize;
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + dataSize);
+    if (!chunk) return NULL;
+    chunk->prev = self->chunk;
+    chunk->size = dataSize;
+    self->chunk = chunk;
+    start = padding(chunk->data, alignment);
+  }
+  self->used = start + size;
+  self->last = self->chunk->data + start;
+  return self->last;
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t oldSize,
+                           size_t newSize) {
+  Arena *self = ctx;
+  if (!ptr) return arena_alloc(ctx, newSize, 0);
+
+  // The most recent block can change size in place if it fits
+  if (ptr == self->last) {
+    size_t start = self->last - self->chunk->data;
+    if (newSize <= self->chunk->size - start) {
+      self->used = start + newSize;
+      return ptr;
+    }
+  } else if (newSize <= oldSize) {
+    return ptr;
+  }
+  void *newMem = arena_alloc(ctx, newSize, 0);
+  if (newMem) memcpy(newMem, ptr, oldSize < newSize ? oldSize : newSize);
+  return newMem;
+}
+
+static void arena_free(void *ctx, void *ptr, size_t size) {
+  Arena *self = ctx;
+  (void)size;
+  if (ptr && ptr == self->last) {
+    self->used = self->last - self->chunk->data;
+    self->last = NULL;
+  }
+}
+
+Arena *Arena_new(size_t chunkSize) {
+  Arena *self = malloc(sizeof(Arena));
+  if (!self) return NULL;
+  self->allocator.alloc = arena_alloc;
+  self->allocator.realloc = arena_realloc;
+  self->allocator.free = arena_free;
+  self->allocator.ctx = self;
+  self->chunk = NULL;
+  self->used = 0;
+  self->chunkSize = chunkSize;
+  self->last = NULL;
+  return self;
+}
+
+void Arena_reset(Arena *self) {
+  if (!self || !self->chunk) return;
+  while (self->chunk->prev) {
+    ArenaChunk *prev = self->chunk->prev;
+    free(self->chunk);
+    self->chunk = prev;
+  }
+  self->used = 0;
+  self->last = NULL;
+}
+
+void Arena_delete(Arena *self) {
+  if (!self) return;
+  Arena_reset(self);
+  free(self->chunk);
+  free(self);
+}
+
+const Allocator *Arena_allocator(Arena *self) {
+  return &self->allocator;
+}
@@ -0,0 +1,77 @@
+/*
+
+An allocator is a set of callbacks that containers use instead of
+calling malloc(), realloc(), and free() directly.  Containers created
+with the same arena allocator can be released all at once by freeing
+the arena, rather than one by one.
+
+*/
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+typedef struct Allocator {
+  /**
+   * Allocates a block.
+   * @param ctx the allocator's context
+   * @param size the size in bytes, possibly 0
+   * @param alignment a power of two, or 0 for malloc()'s alignment
+   * @return the block, or NULL if out of memory
+   */
+  void *(*alloc)(void *ctx, size_t size, size_t alignment);
+
+  /**
+   * Resizes a block allocated with alignment 0, preserving its
+   * contents up to the smaller of the two sizes.
+   * @return the block, or NULL if out of memory, in which case the
+   * original block is still valid
+   */
+  void *(*realloc)(void *ctx, void *ptr, size_t oldSize, size_t newSize);
+
+  /**
+   * Frees a block.  Does nothing if ptr is NULL.
+   * @param size the size with which it was allocated or last resized
+   */
+  void (*free)(void *ctx, void *ptr, size_t size);
+
+  void *ctx;
+} Allocator;
+
+/**
+ * Calls malloc(), aligned_alloc(), realloc(), and free().
+ */
+extern const Allocator Allocator_libc;
+
+typedef struct Arena Arena;
+
+/**
+ * Creates a bump allocator that carves blocks out of large chunks
+ * of memory.  Freeing or resizing the most recent block reclaims or
+ * extends it in place; other frees are deferred until the arena is
+ * reset or deleted.
+ * @param chunkSize the size in bytes of each chunk to request from
+ * malloc(); larger blocks get a chunk of their own
+ * @return the arena, or NULL if out of memory
+ */
+Arena *Arena_new(size_t chunkSize);
+
+/**
+ * Frees an arena and every block allocated from it.
+ */
+void Arena_delete(Arena *self);
+
+/**
+ * Frees every block allocated from an arena at once, keeping one
+ * chunk for reuse.
+ */
+void Arena_reset(Arena *self);
+
+/**
+ * Returns an allocator that allocates from an arena.  Valid as long
+ * as the arena is.
+ */
+const Allocator *Arena_allocator(Arena *self);
+
+#endif
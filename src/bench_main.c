@@ -0,0 +1,518 @@
+/*
+
+Benchmarks for the container library
+
+Times the allocation patterns that loading a module produces --
+many small lists built one element at a time, and maps filled from
+empty -- with the C library's allocator and with an arena, so that a
+change to either can be judged by numbers rather than by feel.
+Also times editing one long list as a gap list and as a chunk list.
+
+*/
+
+/* to build:
+gcc -Wall -Wextra -O2 -pthread -o bench bench_main.c allocator.c gaplist.c hashmap.c frozenmap.c interntable.c pcmring.c chunklist.c
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "allocator.h"
+#include "gaplist.h"
+#include "chunklist.h"
+#include "hashmap.h"
+#include "frozenmap.h"
+#include "typedmap.h"
+#include "interntable.h"
+#include "pcmring.h"
+
+#define NUM_LISTS 4096
+#define ROWS_PER_LIST 64
+#define NUM_MAPS 64
+#define KEYS_PER_MAP 4096
+#define LOOKUPS_PER_KEY 64
+#define ARENA_CHUNK_SIZE 65536
+#define INTERN_KEYS 65536
+#define INTERN_MAX_THREADS 16
+#define RING_SAMPLES (1 << 22)
+#define RING_CAPACITY 4096
+#define RING_MAX_BLOCK 512
+#define EDIT_ROWS (1 << 15)
+#define EDIT_OPS 4096
+#define NUM_RUNS 5
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Workloads ////////////////////////////////////////////////////////
+
+typedef struct BenchRow {
+  unsigned char note, instrument, volume, padding0;
+  unsigned char effects[12];
+} BenchRow;
+
+/**
+ * Builds many pattern-sized lists a row at a time, then frees them.
+ * @param arena if not NULL, allocate from this arena and free
+ * everything by resetting it instead of deleting each list
+ * @return a checksum, so that the work cannot be optimized away
+ */
+static size_t bench_lists(Arena *arena) {
+  static GapList *lists[NUM_LISTS];
+  const Allocator *alloc = arena ? Arena_allocator(arena) : &Allocator_libc;
+  size_t checksum = 0;
+  for (size_t i = 0; i < NUM_LISTS; ++i) {
+    lists[i] = Gap_newWithAllocator(alloc, sizeof(BenchRow), 4, 0);
+    if (!lists[i]) return 0;
+    for (size_t r = 0; r < ROWS_PER_LIST; ++r) {
+      BenchRow row = {0};
+      row.note = r;
+      row.instrument = i;
+      Gap_add(lists[i], &row);
+    }
+  }
+  for (size_t i = 0; i < NUM_LISTS; ++i) {
+    checksum += Gap_size(lists[i]);
+    if (!arena) Gap_delete(lists[i]);
+  }
+  if (arena) Arena_reset(arena);
+  return checksum;
+}
+
+/**
+ * Defines a workload that fills one long list, then overwrites,
+ * inserts, and removes a row at pseudorandom positions, as editing a
+ * long pattern does.  GapList and ChunkList share an API, so the
+ * same body serves both.
+ * @param name the function to define
+ * @param List the list type
+ * @param P the prefix of the list's functions
+ */
+#define DEFINE_EDIT_BENCH(name, List, P) \
+static size_t name(Arena *arena) { \
+  (void)arena; \
+  List *v = P##_new(sizeof(BenchRow), EDIT_ROWS); \
+  if (!v) return 0; \
+  for (size_t r = 0; r < EDIT_ROWS; ++r) { \
+    BenchRow row = {0}; \
+    row.note = r; \
+    if (!P##_add(v, &row)) break; \
+  } \
+  size_t checksum = 0; \
+  uint32_t lcg = 1; \
+  for (size_t i = 0; i < EDIT_OPS && P##_size(v) == EDIT_ROWS; ++i) { \
+    BenchRow row = {0}; \
+    row.note = i; \
+    lcg = lcg * 1103515245u + 12345u; \
+    P##_set(v, (lcg >> 8) % EDIT_ROWS, &row); \
+    lcg = lcg * 1103515245u + 12345u; \
+    P##_seek(v, (lcg >> 8) % (EDIT_ROWS + 1)); \
+    if (!P##_add(v, &row)) break; \
+    lcg = lcg * 1103515245u + 12345u; \
+    checksum += P##_remove(v, (lcg >> 8) % (EDIT_ROWS + 1)); \
+  } \
+  P##_delete(v); \
+  return checksum; \
+}
+
+DEFINE_EDIT_BENCH(bench_gap_edits, GapList, Gap)
+DEFINE_EDIT_BENCH(bench_chunk_edits, ChunkList, Chunk)
+
+static int key_cmp(const void *a, const void *b) {
+  return *(const uint32_t *)a != *(const uint32_t *)b;
+}
+
+static HashMapHashValue key_hash(const void *a) {
+  uint32_t x = *(const uint32_t *)a;
+  x ^= x >> 16;
+  x *= 0x45d9f3bu;
+  x ^= x >> 16;
+  return x;
+}
+
+/**
+ * Fills many maps from empty, then frees them.
+ * @param arena as for bench_lists()
+ * @param presize nonzero to reserve room for all keys up front
+ */
+static size_t fill_maps(Arena *arena, int presize) {
+  static uint32_t keys[KEYS_PER_MAP];
+  static HashMap *maps[NUM_MAPS];
+  const Allocator *alloc = arena ? Arena_allocator(arena) : &Allocator_libc;
+  size_t checksum = 0;
+  for (size_t k = 0; k < KEYS_PER_MAP; ++k) keys[k] = k * 2654435761u;
+  for (size_t i = 0; i < NUM_MAPS; ++i) {
+    maps[i] = HashMap_newWithAllocator(alloc, key_cmp, key_hash);
+    if (!maps[i]) return 0;
+    if (presize) HashMap_reserve(maps[i], KEYS_PER_MAP);
+    for (size_t k = 0; k < KEYS_PER_MAP; ++k) {
+      HashMap_put(maps[i], &keys[k], &keys[k]);
+    }
+  }
+  for (size_t i = 0; i < NUM_MAPS; ++i) {
+    checksum += HashMap_size(maps[i]);
+    if (!arena) HashMap_delete(maps[i]);
+  }
+  if (arena) Arena_reset(arena);
+  return checksum;
+}
+
+static size_t bench_maps(Arena *arena) {
+  return fill_maps(arena, 0);
+}
+
+static size_t bench_reserved_maps(Arena *arena) {
+  return fill_maps(arena, 1);
+}
+
+#define BENCH_KEY_HASH(k) (k)
+#define BENCH_KEY_EQUAL(a, b) ((a) == (b))
+HASHMAP_DEFINE(BenchInlineMap, uint32_t, uint32_t *,
+               BENCH_KEY_HASH, BENCH_KEY_EQUAL)
+
+static uint32_t lookup_keys[KEYS_PER_MAP];
+static HashMap *lookup_map;
+static FrozenMap *lookup_frozen;
+static BenchInlineMap *lookup_inline;
+
+/**
+ * Builds the map that the lookup benchmarks read, and a frozen copy.
+ * @return nonzero if successful
+ */
+static int prepare_lookups(void) {
+  lookup_map = HashMap_new(key_cmp, key_hash);
+  lookup_inline = BenchInlineMap_new(KEYS_PER_MAP);
+  if (!lookup_map || !lookup_inline) return 0;
+  for (size_t k = 0; k < KEYS_PER_MAP; ++k) {
+    lookup_keys[k] = k * 2654435761u;
+    HashMap_put(lookup_map, &lookup_keys[k], &lookup_keys[k]);
+    BenchInlineMap_put(lookup_inline, lookup_keys[k], &lookup_keys[k]);
+  }
+  lookup_frozen = HashMap_freeze(lookup_map);
+  return lookup_frozen != 0;
+}
+
+/**
+ * Looks up every key of a full map many times.
+ */
+static size_t bench_map_lookups(Arena *arena) {
+  (void)arena;
+  size_t checksum = 0;
+  for (size_t i = 0; i < LOOKUPS_PER_KEY; ++i) {
+    for (size_t k = 0; k < KEYS_PER_MAP; ++k) {
+      checksum += HashMap_get(lookup_map, &lookup_keys[k]) == &lookup_keys[k];
+    }
+  }
+  return checksum;
+}
+
+/**
+ * Looks up the same keys in the frozen copy.
+ */
+static size_t bench_frozen_lookups(Arena *arena) {
+  (void)arena;
+  size_t checksum = 0;
+  for (size_t i = 0; i < LOOKUPS_PER_KEY; ++i) {
+    for (size_t k = 0; k < KEYS_PER_MAP; ++k) {
+      checksum += FrozenMap_get(lookup_frozen, &lookup_keys[k])
+                  == &lookup_keys[k];
+    }
+  }
+  return checksum;
+}
+
+/**
+ * Looks up the same keys, by value, in a map that stores them inline.
+ */
+static size_t bench_inline_lookups(Arena *arena) {
+  (void)arena;
+  size_t checksum = 0;
+  for (size_t i = 0; i < LOOKUPS_PER_KEY; ++i) {
+    for (size_t k = 0; k < KEYS_PER_MAP; ++k) {
+      uint32_t **value = BenchInlineMap_get(lookup_inline, lookup_keys[k]);
+      checksum += value && *value == &lookup_keys[k];
+    }
+  }
+  return checksum;
+}
+
+// Concurrent interning ////////////////////////////////////////////
+
+typedef struct InternWorker {
+  pthread_t thread;
+  size_t id;
+  int locked;  // nonzero to use a HashMap behind a mutex
+  uint32_t keys[INTERN_KEYS];  // this thread's own copies of the keys
+  const uint32_t *canonical[INTERN_KEYS];
+} InternWorker;
+
+static InternWorker *intern_workers;
+static InternTable *intern_table;
+static HashMap *intern_map;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *intern_worker(void *arg) {
+  InternWorker *w = arg;
+
+  // Each thread starts at a different key, so that threads both race
+  // to add the same keys and find keys that others have added
+  for (size_t i = 0; i < INTERN_KEYS; ++i) {
+    size_t k = (i + w->id * (INTERN_KEYS / 7)) % INTERN_KEYS;
+    const void *canonical;
+    if (w->locked) {
+      pthread_mutex_lock(&intern_lock);
+      canonical = HashMap_setdefault(intern_map, &w->keys[k], &w->keys[k]);
+      pthread_mutex_unlock(&intern_lock);
+      if (!canonical) canonical = &w->keys[k];
+    } else {
+      canonical = InternTable_intern(intern_table, &w->keys[k]);
+    }
+    w->canonical[k] = canonical;
+  }
+  return 0;
+}
+
+/**
+ * Checks that every thread got the same canonical copy of each key
+ * and that each distinct key was added once.
+ */
+static int check_interned(size_t num_threads, size_t size) {
+  if (size != INTERN_KEYS) return 0;
+  for (size_t k = 0; k < INTERN_KEYS; ++k) {
+    const uint32_t *canonical = intern_workers[0].canonical[k];
+    if (!canonical || *canonical != intern_workers[0].keys[k]) return 0;
+    for (size_t t = 1; t < num_threads; ++t) {
+      if (intern_workers[t].canonical[k] != canonical) return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Has several threads intern the same keys at once, checks the
+ * results, and prints the best throughput.
+ * @param locked nonzero to use a HashMap behind a mutex instead of
+ * an InternTable
+ */
+static void run_intern(int locked, size_t num_threads) {
+  double best = 0;
+  int ok = 1;
+  for (unsigned int i = 0; i < NUM_RUNS; ++i) {
+    if (locked) {
+      intern_map = HashMap_new(key_cmp, key_hash);
+      if (intern_map) HashMap_reserve(intern_map, INTERN_KEYS);
+    } else {
+      intern_table = InternTable_new(INTERN_KEYS, key_cmp, key_hash);
+    }
+    if (!(locked ? (void *)intern_map : (void *)intern_table)) {
+      ok = 0;
+      break;
+    }
+
+    double start = now();
+    size_t started = 0;
+    for (; started < num_threads; ++started) {
+      InternWorker *w = &intern_workers[started];
+      w->locked = locked;
+      if (pthread_create(&w->thread, 0, intern_worker, w)) break;
+    }
+    for (size_t t = 0; t < started; ++t) {
+      pthread_join(intern_workers[t].thread, 0);
+    }
+    double elapsed = now() - start;
+    if (i == 0 || elapsed < best) best = elapsed;
+
+    size_t size = locked ? HashMap_size(intern_map)
+                         : InternTable_size(intern_table);
+    ok = ok && started == num_threads && check_interned(num_threads, size);
+    HashMap_delete(intern_map);
+    InternTable_delete(intern_table);
+    intern_map = 0;
+    intern_table = 0;
+  }
+  printf("intern %-6s %2zu threads %8.3f ms %7.2f M/s%s\n",
+         locked ? "locked" : "free", num_threads, best * 1e3,
+         num_threads * INTERN_KEYS / best * 1e-6,
+         ok ? "" : " CHECK FAILED");
+}
+
+/**
+ * Runs the interning benchmark with 1, 2, 4, ... threads up to the
+ * number of processors.
+ * @param num_cpus the number of processors, or 0 to ask the system
+ * @return nonzero if successful
+ */
+static int bench_interning(long num_cpus) {
+  if (num_cpus <= 0) num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_threads = num_cpus < 1 ? 1
+                       : num_cpus > INTERN_MAX_THREADS ? INTERN_MAX_THREADS
+                       : (size_t)num_cpus;
+  intern_workers = malloc(max_threads * sizeof(InternWorker));
+  if (!intern_workers) return 0;
+  for (size_t t = 0; t < max_threads; ++t) {
+    intern_workers[t].id = t;
+    for (size_t k = 0; k < INTERN_KEYS; ++k) {
+      intern_workers[t].keys[k] = k * 2654435761u;
+    }
+  }
+  for (int locked = 0; locked < 2; ++locked) {
+    for (size_t n = 1; ; n *= 2) {
+      if (n > max_threads) n = max_threads;
+      run_intern(locked, n);
+      if (n == max_threads) break;
+    }
+  }
+  free(intern_workers);
+  return 1;
+}
+
+// Sample ring //////////////////////////////////////////////////////
+
+static PcmRing *ring;
+
+/**
+ * Writes a counting sequence to the ring in blocks of varying size,
+ * as a player writes spans between ticks, yielding while it is full.
+ */
+static void *ring_producer(void *arg) {
+  (void)arg;
+  int16_t block[RING_MAX_BLOCK];
+  uint32_t lcg = 1;
+  for (size_t i = 0; i < RING_SAMPLES; ) {
+    lcg = lcg * 1103515245u + 12345u;
+    size_t n = 1 + (lcg >> 16) % RING_MAX_BLOCK;
+    if (n > RING_SAMPLES - i) n = RING_SAMPLES - i;
+    for (size_t t = 0; t < n; ++t) block[t] = i + t;
+    for (size_t done = 0; done < n; ) {
+      size_t written = PcmRing_write(ring, block + done, n - done);
+      if (!written) sched_yield();
+      done += written;
+    }
+    i += n;
+  }
+  PcmRing_close(ring);
+  return 0;
+}
+
+/**
+ * Reads fixed blocks from the ring, as an output device would, and
+ * checks that every sample arrives once and in order.
+ * @return NULL if the sequence was intact, or non-NULL if not
+ */
+static void *ring_consumer(void *arg) {
+  (void)arg;
+  int16_t block[256];
+  size_t expected = 0;
+  int ok = 1;
+  while (!PcmRing_finished(ring)) {
+    size_t n = PcmRing_read(ring, block, sizeof block / sizeof block[0]);
+    if (!n) sched_yield();
+    for (size_t t = 0; t < n; ++t) {
+      if (block[t] != (int16_t)(expected + t)) ok = 0;
+    }
+    expected += n;
+  }
+  return ok && expected == RING_SAMPLES ? 0 : ring;
+}
+
+/**
+ * Streams samples through a ring between two threads and prints the
+ * best throughput and the ring's statistics for that run.  The
+ * consumer does not wait for a full block, so its underruns count
+ * how often it caught up with the producer.
+ */
+static int bench_ring(void) {
+  double best = 0;
+  int ok = 1;
+  PcmRingStats stats = {0};
+  for (unsigned int i = 0; i < NUM_RUNS; ++i) {
+    ring = PcmRing_new(RING_CAPACITY);
+    if (!ring) return 0;
+    pthread_t producer, consumer;
+    void *consumer_result = ring;
+    double start = now();
+    if (pthread_create(&consumer, 0, ring_consumer, 0)) {
+      ok = 0;
+    } else {
+      if (pthread_create(&producer, 0, ring_producer, 0)) {
+        ok = 0;
+        PcmRing_close(ring);
+      } else {
+        pthread_join(producer, 0);
+      }
+      pthread_join(consumer, &consumer_result);
+    }
+    double elapsed = now() - start;
+    ok = ok && !consumer_result;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+      PcmRing_stats(ring, &stats);
+    }
+    PcmRing_delete(ring);
+    ring = 0;
+  }
+  printf("ring %8.3f ms %7.2f M/s; capacity %zu, peak lead %zu, "
+         "%lu underruns%s\n",
+         best * 1e3, RING_SAMPLES / best * 1e-6, stats.capacity,
+         stats.peak_lead, stats.underruns, ok ? "" : " CHECK FAILED");
+  return 1;
+}
+
+// Driver ///////////////////////////////////////////////////////////
+
+typedef size_t (*BenchFunc)(Arena *arena);
+
+/**
+ * Runs a workload several times and prints the best time.
+ * @param num_ops how many elements each run adds, for per-op time
+ */
+static void run(const char *name, BenchFunc fn, Arena *arena,
+                size_t num_ops) {
+  double best = 0;
+  size_t checksum = 0;
+  for (unsigned int i = 0; i < NUM_RUNS; ++i) {
+    double start = now();
+    checksum = fn(arena);
+    double elapsed = now() - start;
+    if (i == 0 || elapsed < best) best = elapsed;
+  }
+  printf("%-8s %-6s %8.3f ms %7.2f ns/op",
+         name, arena ? "arena" : "libc", best * 1e3, best * 1e9 / num_ops);
+  printf("%s\n", checksum == num_ops ? "" : " CHECKSUM MISMATCH");
+}
+
+int main(int argc, char **argv) {
+  // An optional argument sets the most threads to intern with
+  long num_cpus = argc > 1 ? strtol(argv[1], 0, 10) : 0;
+
+  Arena *arena = Arena_new(ARENA_CHUNK_SIZE);
+  if (!arena || !prepare_lookups()) {
+    fputs("bench: out of memory\n", stderr);
+    return EXIT_FAILURE;
+  }
+  run("lists", bench_lists, 0, NUM_LISTS * ROWS_PER_LIST);
+  run("lists", bench_lists, arena, NUM_LISTS * ROWS_PER_LIST);
+  run("gapedit", bench_gap_edits, 0, EDIT_OPS);
+  run("chkedit", bench_chunk_edits, 0, EDIT_OPS);
+  run("maps", bench_maps, 0, NUM_MAPS * KEYS_PER_MAP);
+  run("maps", bench_maps, arena, NUM_MAPS * KEYS_PER_MAP);
+  run("reserved", bench_reserved_maps, 0, NUM_MAPS * KEYS_PER_MAP);
+  run("reserved", bench_reserved_maps, arena, NUM_MAPS * KEYS_PER_MAP);
+  run("get", bench_map_lookups, 0, LOOKUPS_PER_KEY * KEYS_PER_MAP);
+  run("frozen", bench_frozen_lookups, 0, LOOKUPS_PER_KEY * KEYS_PER_MAP);
+  run("inline", bench_inline_lookups, 0, LOOKUPS_PER_KEY * KEYS_PER_MAP);
+  if (!bench_interning(num_cpus)) fputs("bench: out of memory\n", stderr);
+  if (!bench_ring()) fputs("bench: out of memory\n", stderr);
+  BenchInlineMap_delete(lookup_inline);
+  FrozenMap_delete(lookup_frozen);
+  HashMap_delete(lookup_map);
+  Arena_delete(arena);
+  return 0;
+}
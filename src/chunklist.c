@@ -0,0 +1,448 @@
+/* ChunkList
+
+An indexable skip list of fixed-capacity chunks.
+
+*/
+
+#include "chunklist.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_MAX_LEVEL 16
+#define CHUNK_BYTES 4096
+#define CHUNK_MIN_ELS 4
+
+typedef struct ChunkNode ChunkNode;
+
+typedef struct ChunkLink {
+  ChunkNode *next;
+
+  /* Index of next's first element minus index of this node's first
+     element.  When next is NULL, the number of elements from this
+     node's first element to the end of the list. */
+  size_t width;
+} ChunkLink;
+
+struct ChunkNode {
+  size_t nEls;  // number of valid elements in data
+  unsigned int level;  // number of links
+  char *data;  // chunkCap elements, allocated with the node
+  ChunkLink links[];
+};
+
+struct ChunkList {
+  size_t elSize;  // size of an element in bytes
+  size_t chunkCap;  // number of elements in each chunk
+  size_t nEls;  // number of valid elements
+  size_t insertionPoint;  // point where elements can be inserted
+  uint_least32_t rng;  // state for choosing node levels
+  ChunkNode *head;  // no elements and CHUNK_MAX_LEVEL links
+};
+
+/* Searching ********************************************************/
+
+/**
+ * Finds, for each level, the last node whose first element is at or
+ * before index i.  update[0] is the chunk that holds i (or that would
+ * hold it if i is the size), or the head if there are no chunks.
+ * @param update the node for each level is written here
+ * @param updatePos the index of each node's first element is written here
+ */
+static void find(ChunkList *v, size_t i, ChunkNode **update,
+                 size_t *updatePos) {
+  ChunkNode *x = v->head;
+  size_t pos = 0;
+  for (unsigned int l = CHUNK_MAX_LEVEL; l-- > 0; ) {
+    while (x->links[l].next && pos + x->links[l].width <= i) {
+      pos += x->links[l].width;
+      x = x->links[l].next;
+    }
+    update[l] = x;
+    updatePos[l] = pos;
+  }
+}
+
+/**
+ * Finds, for each level, the last node before target.
+ * @param targetPos the index of target's first element
+ */
+static void findBefore(ChunkList *v, const ChunkNode *target,
+                       size_t targetPos, ChunkNode **update) {
+  ChunkNode *x = v->head;
+  size_t pos = 0;
+  for (unsigned int l = CHUNK_MAX_LEVEL; l-- > 0; ) {
+    // Nonempty chunks before target start strictly before it
+    while (x->links[l].next && x->links[l].next != target
+           && pos + x->links[l].width < targetPos) {
+      pos += x->links[l].width;
+      x = x->links[l].next;
+    }
+    update[l] = x;
+  }
+}
+
+/* Linking **********************************************************/
+
+static ChunkNode *newNode(ChunkList *v) {
+  // Each level above 1 is present with probability 1/4
+  uint_least32_t x = v->rng;
+  x ^= x << 13;
+  x ^= (x & 0xFFFFFFFFu) >> 17;
+  x ^= x << 5;
+  x &= 0xFFFFFFFFu;
+  v->rng = x;
+  unsigned int level = 1;
+  while (level < CHUNK_MAX_LEVEL && (x & 3) == 0) {
+    ++level;
+    x >>= 2;
+  }
+
+  ChunkNode *node = malloc(sizeof(ChunkNode) + level * sizeof(ChunkLink)
+                           + v->chunkCap * v->elSize);
+  if (!node) {
+    return NULL;
+  }
+  node->nEls = 0;
+  node->level = level;
+  node->data = (char *)&node->links[level];
+  return node;
+}
+
+/**
+ * Links a node after the nodes in update, without changing the
+ * number of elements any link spans, then makes the node the new
+ * predecessor at its levels.
+ * @param yPos the index of y's first element
+ */
+static void linkAfter(ChunkNode **update, size_t *updatePos,
+                      ChunkNode *y, size_t yPos) {
+  for (unsigned int l = 0; l < y->level; ++l) {
+    ChunkNode *p = update[l];
+    y->links[l].next = p->links[l].next;
+    y->links[l].width = updatePos[l] + p->links[l].width - yPos;
+    p->links[l].next = y;
+    p->links[l].width = yPos - updatePos[l];
+    update[l] = y;
+    updatePos[l] = yPos;
+  }
+}
+
+/**
+ * Unlinks and frees a node whose elements have been removed or
+ * moved into its predecessor.
+ * @param update the last node before x at each level
+ */
+static void unlink(ChunkNode **update, ChunkNode *x) {
+  for (unsigned int l = 0; l < x->level; ++l) {
+    update[l]->links[l].next = x->links[l].next;
+    update[l]->links[l].width += x->links[l].width;
+  }
+  free(x);
+}
+
+/**
+ * Frees nodes chained through links[0] that are not in a list.
+ */
+static void freeChain(ChunkNode *x) {
+  while (x) {
+    ChunkNode *next = x->links[0].next;
+    free(x);
+    x = next;
+  }
+}
+
+/* Public operations ************************************************/
+
+ChunkList *Chunk_new(size_t elSize, size_t capacity) {
+  (void)capacity;
+  if (elSize == 0) {
+    return NULL;
+  }
+  ChunkList *v = malloc(sizeof(ChunkList));
+  if (!v) {
+    return NULL;
+  }
+  v->head = malloc(sizeof(ChunkNode) + CHUNK_MAX_LEVEL * sizeof(ChunkLink));
+  if (!v->head) {
+    free(v);
+    return NULL;
+  }
+  v->head->nEls = 0;
+  v->head->level = CHUNK_MAX_LEVEL;
+  v->head->data = NULL;
+  v->elSize = elSize;
+  v->chunkCap = CHUNK_BYTES / elSize;
+  if (v->chunkCap < CHUNK_MIN_ELS) {
+    v->chunkCap = CHUNK_MIN_ELS;
+  }
+  v->rng = 2463534242u;
+  for (unsigned int l = 0; l < CHUNK_MAX_LEVEL; ++l) {
+    v->head->links[l].next = NULL;
+  }
+  Chunk_clear(v);
+  return v;
+}
+
+static void cloneSpan(void *els, size_t n, void *ctx) {
+  ChunkList **dst = ctx;
+  if (*dst && !Chunk_addAll(*dst, els, n)) {
+    Chunk_delete(*dst);
+    *dst = NULL;
+  }
+}
+
+ChunkList *Chunk_clone(ChunkList *v) {
+  if (!v) {
+    return NULL;
+  }
+  ChunkList *copy = Chunk_new(v->elSize, v->nEls);
+  Chunk_forEachSpan(v, cloneSpan, &copy);
+  return copy;
+}
+
+void Chunk_clear(ChunkList *v) {
+  if (!v) {
+    return;
+  }
+  freeChain(v->head->links[0].next);
+  for (unsigned int l = 0; l < CHUNK_MAX_LEVEL; ++l) {
+    v->head->links[l].next = NULL;
+    v->head->links[l].width = 0;
+  }
+  v->nEls = 0;
+  v->insertionPoint = 0;
+}
+
+void Chunk_delete(ChunkList *v) {
+  if (v) {
+    Chunk_clear(v);
+    free(v->head);
+    free(v);
+  }
+}
+
+size_t Chunk_elSize(ChunkList *v) {
+  return v ? v->elSize : 0;
+}
+
+size_t Chunk_size(ChunkList *v) {
+  return v ? v->nEls : 0;
+}
+
+void Chunk_seek(ChunkList *v, size_t newIP) {
+  if (v) {
+    v->insertionPoint = newIP < v->nEls ? newIP : v->nEls;
+  }
+}
+
+size_t Chunk_tell(ChunkList *v) {
+  return v ? v->insertionPoint : 0;
+}
+
+void *Chunk_addAll(ChunkList *restrict v, const void *restrict src, size_t n) {
+  if (!v || !n) {
+    return NULL;
+  }
+  size_t elSize = v->elSize, cap = v->chunkCap;
+  ChunkNode *update[CHUNK_MAX_LEVEL];
+  size_t updatePos[CHUNK_MAX_LEVEL];
+  find(v, v->insertionPoint, update, updatePos);
+  ChunkNode *x = update[0];
+  size_t xPos = updatePos[0];
+  size_t oldEls = x->nEls;
+  size_t off = v->insertionPoint - xPos;
+
+  // Allocate everything that could fail before changing anything:
+  // new chunks for what doesn't fit in x and a copy of x's elements
+  // after the insertion point
+  size_t nNewNodes = x == v->head
+                     ? (n + cap - 1) / cap
+                     : (oldEls + n + cap - 1) / cap - 1;
+  ChunkNode *spares = NULL;
+  for (size_t i = 0; i < nNewNodes; ++i) {
+    ChunkNode *node = newNode(v);
+    if (!node) {
+      freeChain(spares);
+      return NULL;
+    }
+    node->links[0].next = spares;
+    spares = node;
+  }
+  size_t nTail = oldEls - off;
+  char *tail = NULL;
+  if (nNewNodes && nTail) {
+    tail = malloc(nTail * elSize);
+    if (!tail) {
+      freeChain(spares);
+      return NULL;
+    }
+    memcpy(tail, x->data + off * elSize, nTail * elSize);
+  }
+
+  // Every link that reaches past the insertion point now spans
+  // n more elements
+  for (unsigned int l = 0; l < CHUNK_MAX_LEVEL; ++l) {
+    update[l]->links[l].width += n;
+  }
+  v->nEls += n;
+  v->insertionPoint += n;
+
+  if (!nNewNodes) {
+    // Everything fits in this chunk
+    char *dst = x->data + off * elSize;
+    memmove(dst + n * elSize, dst, nTail * elSize);
+    memcpy(dst, src, n * elSize);
+    x->nEls += n;
+    return dst;
+  }
+
+  // Fill chunks in order from the new elements then the old tail
+  x->nEls = off;
+  void *first = NULL;
+  const char *from[2] = {src, tail};
+  size_t fromLen[2] = {n, nTail};
+  for (size_t s = 0; s < 2; ++s) {
+    while (fromLen[s]) {
+      if (x == v->head || x->nEls >= cap) {
+        ChunkNode *y = spares;
+        spares = y->links[0].next;
+        size_t yPos = x == v->head ? 0 : xPos + x->nEls;
+        linkAfter(update, updatePos, y, yPos);
+        x = y;
+        xPos = yPos;
+      }
+      size_t k = cap - x->nEls;
+      if (k > fromLen[s]) {
+        k = fromLen[s];
+      }
+      char *dst = x->data + x->nEls * elSize;
+      if (!first) {
+        first = dst;
+      }
+      memcpy(dst, from[s], k * elSize);
+      x->nEls += k;
+      from[s] += k * elSize;
+      fromLen[s] -= k;
+    }
+  }
+
+  // Free any chunks that turned out not to be needed
+  freeChain(spares);
+  free(tail);
+  return first;
+}
+
+void *Chunk_get(ChunkList *v, size_t i) {
+  if (!v || i >= v->nEls) {
+    return NULL;
+  }
+  ChunkNode *update[CHUNK_MAX_LEVEL];
+  size_t updatePos[CHUNK_MAX_LEVEL];
+  find(v, i, update, updatePos);
+  return update[0]->data + (i - updatePos[0]) * v->elSize;
+}
+
+void Chunk_setRange(ChunkList *restrict v, size_t fromIndex, size_t toIndex,
+                    const void *restrict src) {
+  if (!v || toIndex <= fromIndex || toIndex > v->nEls) {
+    return;
+  }
+  size_t elSize = v->elSize;
+  ChunkNode *update[CHUNK_MAX_LEVEL];
+  size_t updatePos[CHUNK_MAX_LEVEL];
+  find(v, fromIndex, update, updatePos);
+  ChunkNode *x = update[0];
+  size_t off = fromIndex - updatePos[0];
+  const char *from = src;
+
+  // Consecutive chunks are linked at level 0
+  while (fromIndex < toIndex) {
+    size_t k = x->nEls - off;
+    if (k > toIndex - fromIndex) {
+      k = toIndex - fromIndex;
+    }
+    memcpy(x->data + off * elSize, from, k * elSize);
+    from += k * elSize;
+    fromIndex += k;
+    x = x->links[0].next;
+    off = 0;
+  }
+}
+
+bool Chunk_removeRange(ChunkList *v, size_t fromIndex, size_t toIndex) {
+  if (!v || toIndex <= fromIndex || toIndex > v->nEls) {
+    return false;
+  }
+  if (v->insertionPoint >= toIndex) {
+    v->insertionPoint -= toIndex - fromIndex;
+  } else if (v->insertionPoint > fromIndex) {
+    v->insertionPoint = fromIndex;
+  }
+
+  size_t elSize = v->elSize;
+  ChunkNode *update[CHUNK_MAX_LEVEL];
+  size_t updatePos[CHUNK_MAX_LEVEL];
+  while (toIndex > fromIndex) {
+    // Remove as much of the range as lies in one chunk
+    find(v, fromIndex, update, updatePos);
+    ChunkNode *x = update[0];
+    size_t xPos = updatePos[0];
+    size_t off = fromIndex - xPos;
+    size_t k = x->nEls - off;
+    if (k > toIndex - fromIndex) {
+      k = toIndex - fromIndex;
+    }
+    char *dst = x->data + off * elSize;
+    memmove(dst, dst + k * elSize, (x->nEls - off - k) * elSize);
+    x->nEls -= k;
+    for (unsigned int l = 0; l < CHUNK_MAX_LEVEL; ++l) {
+      update[l]->links[l].width -= k;
+    }
+    v->nEls -= k;
+    toIndex -= k;
+
+    if (x->nEls == 0) {
+      findBefore(v, x, xPos, update);
+      unlink(update, x);
+      continue;
+    }
+
+    // Merge a nearly empty chunk with the next one if both fit
+    ChunkNode *next = x->links[0].next;
+    if (x->nEls < v->chunkCap / 4 && next
+        && x->nEls + next->nEls <= v->chunkCap) {
+      size_t nextPos = xPos + x->nEls;
+      findBefore(v, next, nextPos, update);
+      memcpy(x->data + x->nEls * elSize, next->data, next->nEls * elSize);
+      x->nEls += next->nEls;
+      unlink(update, next);
+    }
+  }
+  return true;
+}
+
+bool Chunk_removeBefore(ChunkList *v, size_t n) {
+  if (!v || v->insertionPoint < n) {
+    return false;
+  }
+  return n == 0
+         || Chunk_removeRange(v, v->insertionPoint - n, v->insertionPoint);
+}
+
+bool Chunk_removeAfter(ChunkList *v, size_t n) {
+  if (!v || v->nEls - v->insertionPoint < n) {
+    return false;
+  }
+  return n == 0
+         || Chunk_removeRange(v, v->insertionPoint, v->insertionPoint + n);
+}
+
+void Chunk_forEachSpan(ChunkList *v, GapSpanVisitor fn, void *ctx) {
+  if (!v) {
+    return;
+  }
+  for (ChunkNode *x = v->head->links[0].next; x; x = x->links[0].next) {
+    fn(x->data, x->nEls, ctx);
+  }
+}
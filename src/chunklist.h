@@ -0,0 +1,195 @@
+/*
+
+A chunk list stores a sequence as many small arrays ("chunks") linked
+in order by an indexable skip list.  Finding the chunk that holds an
+index takes O(log n) expected time, and inserting or removing elements
+moves only the elements of that one chunk, so edits anywhere in a long
+list are cheap.  A gap list is faster when edits cluster near one
+point, as they do while loading; a chunk list suits an editor where
+rows are inserted and deleted all over a song.
+
+The operations mirror those of GapList under the prefix Chunk_, so
+code can switch between the two by name.  A chunk list has no
+counterpart to Gap_ensureCapacity() or Gap_trimToSize(), as it
+allocates chunks only as it grows, nor to Gap_spans() or
+Gap_getRange(), as its elements are not in at most two runs; scan it
+with Chunk_forEachSpan() instead.
+
+Further reading:
+https://en.wikipedia.org/wiki/Skip_list#Indexable_skiplist
+https://en.wikipedia.org/wiki/Unrolled_linked_list
+
+*/
+
+#ifndef CHUNKLIST_H
+#define CHUNKLIST_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "gaplist.h"
+typedef struct ChunkList ChunkList;
+
+
+/**
+ * Creates a new list with elements of the given size.
+ * @param elSize sizeof(an element)
+ * @param capacity the expected number of elements; unused, as chunks
+ * are allocated as the list grows, but kept so that calls match
+ * Gap_new()
+ */
+ChunkList *Chunk_new(size_t elSize, size_t capacity);
+
+/**
+ * Destroys a list, freeing the memory associated with it
+ * and its elements.
+ */
+void Chunk_delete(ChunkList *v);
+
+/**
+ * Removes all elements from this list.
+ * @param v this list
+ */
+void Chunk_clear(ChunkList *v);
+
+/**
+ * Returns the size in bytes of an element in this list.
+ * @param v this list
+ * @return the size in bytes
+ */
+size_t Chunk_elSize(ChunkList *v);
+
+/**
+ * Returns the number of elements in this list.
+ * @param v this list
+ * @return the number of elements
+ */
+size_t Chunk_size(ChunkList *v);
+
+/**
+ * Tests if this list has no elements.
+ * @param v this list
+ * @return true if the number of elements is zero; false otherwise
+ */
+static inline bool Chunk_isEmpty(ChunkList *v) {
+  return Chunk_size(v) == 0;
+}
+
+/**
+ * Returns a copy of this list and all its elements. The insertion
+ * point in the copy is unspecified.
+ * @param v this list
+ * @return a copy of v, or NULL if out of memory
+ */
+ChunkList *Chunk_clone(ChunkList *v);
+
+/**
+ * Sets the insertion point to the left of an element.
+ * Unlike Gap_seek(), this takes constant time.
+ * @param v this list
+ * @param newIP the position of the insertion point
+ */
+void Chunk_seek(ChunkList *v, size_t newIP);
+
+/**
+ * Returns the current insertion point.
+ * @param v this list
+ * @return the element before which elements will be inserted
+ */
+size_t Chunk_tell(ChunkList *v);
+
+/**
+ * Copies an array of elements into this list at the insertion point
+ * and moves the insertion point past them.
+ * @param v this list
+ * @param src a pointer to the first element
+ * @param n the number of elements in the array
+ * @return a pointer to the first copied element, or NULL if not added
+ */
+void *Chunk_addAll(ChunkList *v, const void *src, size_t n);
+
+/**
+ * Copies a single element into this list at the insertion point.
+ * @param v this list
+ * @param src a pointer to the element
+ * @return a pointer to the copied element, or NULL if not added
+ */
+static inline void *Chunk_add(ChunkList *restrict v, const void *restrict src) {
+  return Chunk_addAll(v, src, 1);
+}
+
+/**
+ * Returns a pointer to the element at the specified index in this list.
+ * Elements at consecutive indices are not necessarily contiguous;
+ * use Chunk_forEachSpan() to scan.
+ * @param v this list
+ * @param i the index
+ */
+void *Chunk_get(ChunkList *v, size_t i);
+
+/**
+ * Overwrites a block of elements. For instance, setting elements
+ * "from" 2 "to" 6 will replace elements 2, 3, 4, and 5 with the
+ * content of a 4-element array.
+ * @param v this list
+ * @param fromIndex the index of the first element to be replaced
+ * @param toIndex the index of the first element after those that shall be set
+ * (same numbering as Python "slice notation")
+ * @param src the array to copy from, which must not overlap fromIndex to toIndex of this list
+ */
+void Chunk_setRange(ChunkList *restrict v, size_t fromIndex, size_t toIndex, const void *restrict src);
+
+/**
+ * Overwrites a single element.
+ * @param v this list
+ * @param i the index of the element to overwrite
+ * @param src the element to write
+ */
+static inline void Chunk_set(ChunkList *restrict v, size_t i, const void *restrict src) {
+  Chunk_setRange(v, i, i + 1, src);
+}
+
+/**
+ * Removes a block of elements. For instance, removing elements
+ * "from" 2 "to" 6 will remove elements 2, 3, 4, and 5.
+ * @param v this list
+ * @param fromIndex the index of the first element to remove
+ * @param toIndex the index of the first element after those that shall be removed
+ * @return true if the specified elements were removed; false if not
+ */
+bool Chunk_removeRange(ChunkList *v, size_t fromIndex, size_t toIndex);
+
+/**
+ * Removes an element.
+ * @param v this list
+ * @param fromIndex the index of the element to be removed
+ * @return true if the specified element was removed; false if not
+ */
+static inline bool Chunk_remove(ChunkList *v, size_t fromIndex) {
+  return Chunk_removeRange(v, fromIndex, fromIndex + 1);
+}
+
+/**
+ * Removes elements preceding this list's insertion point.
+ * @param v this list
+ * @param n the number of elements to remove
+ * @return true if at least n elements were there to remove; false if not
+ */
+bool Chunk_removeBefore(ChunkList *v, size_t n);
+
+/**
+ * Removes elements following this list's insertion point.
+ * @param v this list
+ * @param n the number of elements to remove
+ * @return true if at least n elements were there to remove; false if not
+ */
+bool Chunk_removeAfter(ChunkList *v, size_t n);
+
+/**
+ * Calls a function for each chunk of elements in this list, in order.
+ * @param v this list
+ * @param fn the function to call
+ * @param ctx passed to fn
+ */
+void Chunk_forEachSpan(ChunkList *v, GapSpanVisitor fn, void *ctx);
+
+#endif
@@ -0,0 +1,221 @@
+/*
+read-only maps placed by a minimal perfect hash
+*/
+#include "frozenmap.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define KEYS_PER_BUCKET 4
+#define MAX_SEED 0x7FFFFFFFu
+#define SEED_DIRECT 0x80000000u  // the rest of the seed is a slot index
+
+typedef struct FrozenEntry {
+  HashMapHashValue hashValue;
+  const void *key;
+  void *value;
+} FrozenEntry;
+
+struct FrozenMap {
+  size_t size;  // number of entries, equal to number of slots
+  size_t num_buckets;
+  HashMapComparator cmp;
+  HashMapHasher hash;
+  uint32_t *seeds;  // seeds[num_buckets], after entries
+  FrozenEntry entries[];
+};
+
+/**
+ * Spreads a hash value over 64 bits (MurmurHash3's 64-bit finalizer).
+ */
+static uint64_t fmix(HashMapHashValue hashValue) {
+  uint64_t h = hashValue;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDu;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53u;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * Maps a 64-bit hash onto 0 to n - 1 by multiplying its top 32 bits.
+ */
+static size_t reduce(uint64_t h, size_t n) {
+  return (size_t)(((h >> 32) * (uint64_t)n) >> 32);
+}
+
+static size_t bucket_of(const FrozenMap *self, uint64_t h) {
+  return reduce(h, self->num_buckets);
+}
+
+/**
+ * Finds a key's slot from its mixed hash and its bucket's seed.
+ * Multiplying carries every bit of h and the seed into the top 32
+ * bits, which reduce() uses.
+ */
+static size_t slot_of(const FrozenMap *self, uint64_t h, uint32_t seed) {
+  if (seed & SEED_DIRECT) return seed & ~SEED_DIRECT;
+  uint64_t g = (h ^ (seed * 0x9E3779B97F4A7C15u)) * 0xD6E8FEB86659FD93u;
+  return reduce(g ^ (g << 32), self->size);
+}
+
+// Building /////////////////////////////////////////////////////////
+
+typedef struct FreezeBucket {
+  size_t first;  // index into the keys sorted by bucket
+  size_t length;
+  size_t id;
+} FreezeBucket;
+
+static int bucket_cmp_length(const void *a, const void *b) {
+  const FreezeBucket *ba = a, *bb = b;
+  if (ba->length != bb->length) return ba->length < bb->length ? 1 : -1;
+  return ba->id < bb->id ? -1 : ba->id > bb->id;
+}
+
+/**
+ * Finds a seed that places every key of a bucket in a distinct
+ * free slot, and marks those slots used.
+ * @param slots scratch space for one slot per key in the bucket
+ * @return the seed, or SEED_DIRECT if none was found
+ */
+static uint32_t place_bucket(const FrozenMap *self,
+                             const FrozenEntry *keys, size_t length,
+                             unsigned char *used, size_t *slots) {
+  for (uint32_t seed = 0; seed <= MAX_SEED; ++seed) {
+    size_t i = 0;
+    for (; i < length; ++i) {
+      size_t slot = slot_of(self, fmix(keys[i].hashValue), seed);
+      if (used[slot]) break;
+      size_t j = 0;
+      while (j < i && slots[j] != slot) ++j;
+      if (j < i) break;
+      slots[i] = slot;
+    }
+    if (i == length) {
+      for (i = 0; i < length; ++i) used[slots[i]] = 1;
+      return seed;
+    }
+  }
+  return SEED_DIRECT;
+}
+
+FrozenMap *HashMap_freeze(const HashMap *map) {
+  size_t n = HashMap_size(map);
+  if (n > MAX_SEED) return 0;
+  size_t num_buckets = n / KEYS_PER_BUCKET + 1;
+  FrozenMap *self = malloc(sizeof(FrozenMap) + n * sizeof(FrozenEntry)
+                           + num_buckets * sizeof(uint32_t));
+  FrozenEntry *keys = malloc(n * sizeof(FrozenEntry) + 1);
+  FreezeBucket *buckets = calloc(num_buckets, sizeof(FreezeBucket));
+  unsigned char *used = calloc(n + 1, 1);
+  size_t *slots = malloc(n * sizeof(size_t) + 1);
+  size_t *key_buckets = malloc(n * sizeof(size_t) + 1);
+  HashMapIterator *it = HashMap_iter(map);
+  if (!self || !keys || !buckets || !used || !slots || !key_buckets
+      || !it) {
+    goto fail;
+  }
+  self->size = n;
+  self->num_buckets = num_buckets;
+  self->cmp = HashMap_comparator(map);
+  self->hash = HashMap_hasher(map);
+  self->seeds = (uint32_t *)(self->entries + n);
+
+  // Sort the keys by bucket
+  for (size_t i = 0; i < n; ++i) {
+    FrozenEntry *e = &self->entries[i];
+    HashMapIterator_next(it, &e->key, &e->value);
+    e->hashValue = self->hash(e->key);
+    key_buckets[i] = bucket_of(self, fmix(e->hashValue));
+    buckets[key_buckets[i]].length += 1;
+  }
+  size_t first = 0;
+  for (size_t b = 0; b < num_buckets; ++b) {
+    buckets[b].id = b;
+    buckets[b].first = first;
+    first += buckets[b].length;
+    buckets[b].length = 0;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    FreezeBucket *bucket = &buckets[key_buckets[i]];
+    keys[bucket->first + bucket->length++] = self->entries[i];
+  }
+
+  // Place the biggest buckets first, while most slots are free
+  qsort(buckets, num_buckets, sizeof(FreezeBucket), bucket_cmp_length);
+  size_t next_free = 0;
+  for (size_t b = 0; b < num_buckets; ++b) {
+    const FreezeBucket *bucket = &buckets[b];
+    const FrozenEntry *bucket_keys = keys + bucket->first;
+    uint32_t seed = 0;
+    if (bucket->length > 1) {
+      // Two keys with one hash value land in the same slot whatever
+      // the seed, so no seed would ever be found
+      for (size_t i = 1; i < bucket->length; ++i) {
+        for (size_t j = 0; j < i; ++j) {
+          if (bucket_keys[i].hashValue == bucket_keys[j].hashValue) {
+            goto fail;
+          }
+        }
+      }
+      seed = place_bucket(self, bucket_keys, bucket->length, used, slots);
+      if (seed == SEED_DIRECT) goto fail;
+    } else if (bucket->length == 1) {
+      while (used[next_free]) ++next_free;
+      used[next_free] = 1;
+      seed = SEED_DIRECT | next_free;
+    }
+    self->seeds[bucket->id] = seed;
+    for (size_t i = 0; i < bucket->length; ++i) {
+      size_t slot = slot_of(self, fmix(bucket_keys[i].hashValue), seed);
+      self->entries[slot] = bucket_keys[i];
+    }
+  }
+  goto done;
+
+fail:
+  free(self);
+  self = 0;
+done:
+  HashMapIterator_delete(it);
+  free(key_buckets);
+  free(slots);
+  free(used);
+  free(buckets);
+  free(keys);
+  return self;
+}
+
+void FrozenMap_delete(FrozenMap *self) {
+  free(self);
+}
+
+// Lookup ///////////////////////////////////////////////////////////
+
+size_t FrozenMap_size(const FrozenMap *self) {
+  return self->size;
+}
+
+/**
+ * Returns the entry for a key, or NULL if none.
+ */
+static const FrozenEntry *find(const FrozenMap *self, const void *key) {
+  if (!self->size) return 0;
+  HashMapHashValue hashValue = self->hash(key);
+  uint64_t h = fmix(hashValue);
+  uint32_t seed = self->seeds[bucket_of(self, h)];
+  const FrozenEntry *e = &self->entries[slot_of(self, h, seed)];
+  if (e->hashValue != hashValue || self->cmp(key, e->key) != 0) return 0;
+  return e;
+}
+
+void *FrozenMap_getOrDefault(const FrozenMap *self, const void *key,
+                             void *defaultValue) {
+  const FrozenEntry *e = find(self, key);
+  return e ? e->value : defaultValue;
+}
+
+int FrozenMap_containsKey(const FrozenMap *self, const void *key) {
+  return find(self, key) != 0;
+}
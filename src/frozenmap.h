@@ -0,0 +1,67 @@
+#ifndef FROZENMAP_H
+#define FROZENMAP_H
+
+#include "hashmap.h"
+
+/*
+A frozen map is a read-only copy of a HashMap whose keys are placed
+by a minimal perfect hash: n keys occupy exactly n slots, and each
+key has its own slot.  The hash is found when the map is frozen, much
+as gperf finds one for ftkeywords.gperf at build time.  A lookup
+hashes the key, reads one displacement, and compares the key with
+the one entry in its slot.
+
+Keys are grouped into buckets of about 4.  Buckets are placed largest
+first, each by trying displacements until all its keys land in free
+slots.  Buckets of one key are pointed straight at a free slot.
+
+Nothing in a frozen map changes after HashMap_freeze() returns, so
+threads may look up keys concurrently without locking.
+
+Further reading:
+Belazzougui, Botelho, and Dietzfelbinger.  "Hash, displace, and
+compress."  ESA 2009.
+*/
+
+typedef struct FrozenMap FrozenMap;
+
+/**
+ * Makes a frozen copy of a dictionary.  It uses the same comparator
+ * and hasher, which must not depend on mutable state.  The keys and
+ * values are not copied.
+ * @return the copy, or NULL if out of memory or if two keys have the
+ * same hash value, in which case the caller can keep using the
+ * HashMap
+ */
+FrozenMap *HashMap_freeze(const HashMap *map);
+
+/**
+ * Frees a frozen map.
+ */
+void FrozenMap_delete(FrozenMap *self);
+
+/**
+ * Returns how many keys are associated with a value.
+ */
+size_t FrozenMap_size(const FrozenMap *self);
+
+/**
+ * Returns the value associated with the given key, or defaultValue
+ * if none.
+ */
+void *FrozenMap_getOrDefault(const FrozenMap *self, const void *key,
+                             void *defaultValue);
+
+/**
+ * Returns the value mapped to the given key, or NULL if none.
+ */
+static inline void *FrozenMap_get(const FrozenMap *self, const void *key) {
+  return FrozenMap_getOrDefault(self, key, 0);
+}
+
+/**
+ * Returns nonzero if the given key is associated with a value.
+ */
+int FrozenMap_containsKey(const FrozenMap *self, const void *key);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+decoding and stepping arpeggio, pitch slide, vibrato, and volume
+slide effects
+*/
+#include "fteffects.h"
+#include <string.h>
+
+#define FTFX_MAX_VOLUME8 (FTVOLCOL_MAX * 8)
+
+// One period of a sine wave of amplitude 127
+static const signed char vibrato_sine[FTFX_VIBRATO_PERIOD] = {
+  0, 12, 25, 37, 49, 60, 71, 81, 90, 98, 106, 112, 117, 122, 125, 126,
+  127, 126, 125, 122, 117, 112, 106, 98, 90, 81, 71, 60, 49, 37, 25, 12,
+  0, -12, -25, -37, -49, -60, -71, -81, -90, -98, -106, -112, -117, -122, -125, -126,
+  -127, -126, -125, -122, -117, -112, -106, -98, -90, -81, -71, -60, -49, -37, -25, -12,
+};
+
+void FTEffects_init(FTEffects *self) {
+  memset(self, 0, sizeof(*self));
+  for (size_t c = 0; c < FT_MAX_CHANNELS; ++c) {
+    self->volume8[c] = FTFX_MAX_VOLUME8;
+    self->out_volume[c] = FTVOLCOL_MAX;
+  }
+}
+
+void FTEffects_apply(FTEffects *self, size_t c,
+                     const FTPatEffect effects[FTPAT_MAX_EFFECTS]) {
+  for (size_t j = 0; j < FTPAT_MAX_EFFECTS && effects[j].fx; ++j) {
+    unsigned int value = effects[j].value;
+    switch (effects[j].fx) {
+      case '0':
+        self->arpeggio[c][1] = value >> 4;
+        self->arpeggio[c][2] = value & 0x0F;
+        break;
+      case '1':
+        self->slide[c] = value * FTFX_PITCH_STEP;
+        self->porta_speed[c] = 0;
+        break;
+      case '2':
+        self->slide[c] = -(int)(value * FTFX_PITCH_STEP);
+        self->porta_speed[c] = 0;
+        break;
+      case '3':
+        self->slide[c] = 0;
+        self->porta_speed[c] = value * FTFX_PITCH_STEP;
+        break;
+      case '4':
+        self->vibrato_speed[c] = value >> 4;
+        self->vibrato_depth[c] = value & 0x0F;
+        break;
+      case 'A':
+        self->volume_slide[c] = (int)(value >> 4) - (int)(value & 0x0F);
+        break;
+      case 'V':
+        self->timbre[c] = value;
+        break;
+    }
+  }
+}
+
+void FTEffects_note_on(FTEffects *self, size_t c, unsigned int note,
+                       int sounding) {
+  if (self->porta_speed[c] && sounding) {
+    self->bend[c] += ((int)self->note[c] - (int)note) * 256;
+  } else {
+    self->bend[c] = 0;
+  }
+  self->note[c] = note;
+  self->arpeggio_phase[c] = 0;
+}
+
+void FTEffects_tick(FTEffects *self, size_t n) {
+  for (size_t c = 0; c < n; ++c) {
+    // Outputs
+    unsigned int arpeggio_phase = self->arpeggio_phase[c];
+    unsigned int vibrato_phase = self->vibrato_phase[c];
+    int bend = self->bend[c];
+    int vibrato = vibrato_sine[vibrato_phase] * self->vibrato_depth[c] / 8;
+    self->out_note[c] = self->arpeggio[c][arpeggio_phase];
+    self->out_pitch[c] = bend + vibrato;
+    self->out_volume[c] = self->volume8[c] / 8;
+
+    // Advance
+    // 0x0 alternates the note and note + x, as FamiTracker does
+    unsigned int last_phase = self->arpeggio[c][2] ? 2 : 1;
+    self->arpeggio_phase[c] = arpeggio_phase >= last_phase
+                              ? 0 : arpeggio_phase + 1;
+    self->vibrato_phase[c] = (vibrato_phase + self->vibrato_speed[c])
+                             % FTFX_VIBRATO_PERIOD;
+    bend += self->slide[c];
+    if (bend > FTFX_MAX_BEND) bend = FTFX_MAX_BEND;
+    if (bend < -FTFX_MAX_BEND) bend = -FTFX_MAX_BEND;
+    int porta_speed = self->porta_speed[c];
+    if (bend > porta_speed) {
+      bend -= porta_speed;
+    } else if (bend < -porta_speed) {
+      bend += porta_speed;
+    } else if (porta_speed) {
+      bend = 0;
+    }
+    self->bend[c] = bend;
+    int volume8 = self->volume8[c] + self->volume_slide[c];
+    if (volume8 < 0) volume8 = 0;
+    if (volume8 > FTFX_MAX_VOLUME8) volume8 = FTFX_MAX_VOLUME8;
+    self->volume8[c] = volume8;
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef FTEFFECTS_H
+#define FTEFFECTS_H
+#include "ftmodule.h"
+
+/*
+The effects engine interprets the effect columns of pattern rows that
+change a channel's sound from tick to tick.  FTEffects_apply()
+decodes a row's effects once, when the row is played, into numbers
+that FTEffects_tick() can use without looking at effect letters:
+
+  0xy  arpeggio: cycle the note, note + x, note + y each tick;
+       0x0 alternates the note and note + x
+  1xx  pitch slide up by xx steps each tick; 100 stops
+  2xx  pitch slide down by xx steps each tick; 200 stops
+  3xx  portamento: slide from the previous note to each new note
+       by xx steps each tick; 300 stops
+  4xy  vibrato of speed x and depth y; 400 stops
+  Axy  volume slide up by x/8 and down by y/8 each tick; A00 stops
+  Vxx  timbre: pulse duty or N163 wave, until changed
+
+The three pitch slides replace one another.  A step is
+FTFX_PITCH_STEP 1/256 semitones.  FamiTracker slides the period or
+frequency register by one unit per step, so that the size of a step
+depends on the note and chip; a fixed step is close over the middle
+octaves.
+
+Like envelope cursors, the state of all channels is kept in parallel
+arrays, so that one tick of every channel is a single loop.
+*/
+
+#define FTFX_PITCH_STEP 16
+#define FTFX_MAX_BEND (96 * 256)
+#define FTFX_VIBRATO_PERIOD 64
+
+typedef struct FTEffects {
+  // Decoded from effect columns
+  int slide[FT_MAX_CHANNELS];  // added to bend each tick by 1xx or 2xx
+  int porta_speed[FT_MAX_CHANNELS];  // bend moves this far toward 0
+  unsigned char arpeggio[FT_MAX_CHANNELS][3];  // 0, x, y
+  unsigned char vibrato_speed[FT_MAX_CHANNELS];
+  unsigned char vibrato_depth[FT_MAX_CHANNELS];
+  signed char volume_slide[FT_MAX_CHANNELS];  // in 1/8 volume
+  unsigned char timbre[FT_MAX_CHANNELS];  // base of the timbre envelope
+
+  // Advanced by each tick
+  int bend[FT_MAX_CHANNELS];  // 1/256 semitones from the note
+  unsigned char note[FT_MAX_CHANNELS];  // last note, to slide from
+  unsigned char arpeggio_phase[FT_MAX_CHANNELS];
+  unsigned char vibrato_phase[FT_MAX_CHANNELS];
+  unsigned char volume8[FT_MAX_CHANNELS];  // volume column in 1/8
+
+  // Outputs of the last tick
+  int out_note[FT_MAX_CHANNELS];  // semitones to add to the note
+  int out_pitch[FT_MAX_CHANNELS];  // 1/256 semitones to add
+  unsigned char out_volume[FT_MAX_CHANNELS];  // 0-15
+} FTEffects;
+
+/**
+ * Clears the effects of all channels and sets their volume to 15.
+ */
+void FTEffects_init(FTEffects *self);
+
+/**
+ * Decodes the effects of one row of a channel.  Call before
+ * FTEffects_note_on() for the row's note, so that 3xx on the same row
+ * slides to the note.
+ * @param effects a row's effect columns
+ */
+void FTEffects_apply(FTEffects *self, size_t channel,
+                     const FTPatEffect effects[FTPAT_MAX_EFFECTS]);
+
+/**
+ * Starts a note.  With portamento, a note played while another is
+ * sounding begins at the pitch of the other and slides to its own.
+ * @param note 0-95
+ * @param sounding nonzero if the channel was playing a note
+ */
+void FTEffects_note_on(FTEffects *self, size_t channel, unsigned int note,
+                       int sounding);
+
+/**
+ * Sets a channel's volume from the volume column.
+ * @param volume 0-15
+ */
+static inline void FTEffects_set_volume(FTEffects *self, size_t channel,
+                                        unsigned int volume) {
+  self->volume8[channel] = volume * 8;
+}
+
+/**
+ * Computes the outputs of the first n channels for this tick and
+ * advances their effects.
+ */
+void FTEffects_tick(FTEffects *self, size_t n);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+compiling and stepping volume, arpeggio, pitch, and timbre envelopes
+*/
+#include "ftenvelope.h"
+#include <stdlib.h>
+
+const FTEnvProgram FTEnvProgram_none = {
+  -1, 0, 0, 0, FTENV_NO_RELEASE, {0}, {0}
+};
+
+void FTEnvProgram_compile(FTEnvProgram *restrict out,
+                          const FTEnvelope *restrict env) {
+  size_t length = env->env_length;
+  size_t loop = env->loop_point, release = env->release_point;
+  if (loop >= length) loop = FTENV_MAX_TICKS + 1;
+  if (release >= length) release = FTENV_MAX_TICKS + 1;
+  int has_loop = loop < length, has_release = release < length;
+
+  // How each kind of envelope combines with its base
+  out->base_mask = 0;
+  out->accum_mask = 0;
+  switch (env->parameter) {
+    case FTENVPARAM_ARPEGGIO:
+      if (env->arpeggio_sense != FTARP_FIXED) out->base_mask = -1;
+      if (env->arpeggio_sense == FTARP_RELATIVE) out->accum_mask = -1;
+      break;
+    case FTENVPARAM_PITCH:
+    case FTENVPARAM_HIPITCH:
+      out->base_mask = -1;
+      if (env->arpeggio_sense == FTENVPITCH_RELATIVE) out->accum_mask = -1;
+      break;
+  }
+
+  // An envelope loops at its end only if the loop point is after
+  // the release point; otherwise the loop is taken at the release
+  // point while the note is held, and the envelope ends after it
+  size_t at_end = length;
+  if (has_loop && (!has_release || loop > release)) at_end = loop;
+
+  for (size_t i = 0; i < length; ++i) {
+    out->value[i] = (signed char)env->env_data[i];
+    out->next[i] = i + 1 < length ? i + 1 : at_end;
+  }
+  if (has_release) {
+    out->next[release] = (has_loop && loop <= release) ? loop : release;
+    out->release_target = release + 1 < length ? release + 1 : at_end;
+  } else {
+    out->release_target = FTENV_NO_RELEASE;
+  }
+
+  // The terminal step holds the last value, except that an envelope
+  // whose values accumulate stops changing
+  out->length = length;
+  out->next[length] = length;
+  out->value[length] = 0;
+  if (length > 0 && !out->accum_mask) {
+    out->value[length] = out->value[length - 1];
+  } else if (length == 0 && !out->base_mask) {
+    out->base_mask = -1;
+  }
+}
+
+FTEnvProgram *FTModule_compile_envelopes(FTModule *module) {
+  size_t n = Gap_size(module->all_envelopes);
+  FTEnvProgram *programs = malloc(n * sizeof(FTEnvProgram) + 1);
+  if (!programs) return 0;
+  for (size_t i = 0; i < n; ++i) {
+    FTEnvelope **env = Gap_get(module->all_envelopes, i);
+    FTEnvProgram_compile(&programs[i], *env);
+  }
+  return programs;
+}
+
+void FTEnvCursors_init(FTEnvCursors *self) {
+  for (size_t i = 0; i < FTENV_MAX_CURSORS; ++i) {
+    FTEnvCursors_start(self, i, 0);
+    self->base[i] = 0;
+    self->out[i] = 0;
+  }
+}
+
+void FTEnvCursors_tick(FTEnvCursors *self, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    const FTEnvProgram *program = self->program[i];
+    unsigned int pos = self->pos[i];
+    int value = program->value[pos];
+    int accum = self->accum[i] + (value & program->accum_mask);
+    self->accum[i] = accum;
+    self->out[i] = (self->base[i] & program->base_mask)
+                   + (value & ~program->accum_mask) + accum;
+    self->pos[i] = program->next[pos];
+  }
+}
@@ -0,0 +1,116 @@
+#ifndef FTENVELOPE_H
+#define FTENVELOPE_H
+#include "ftmodule.h"
+
+/*
+An envelope program is an FTEnvelope compiled for playback.  Each step
+has a value and the step to go to on the next tick, with the loop and
+release points already resolved into those jumps and one extra
+terminal step that repeats forever once the envelope ends.  The arpeggio
+sense (or pitch mode) becomes a pair of masks, so that every kind of
+envelope is evaluated by the same branch-free arithmetic:
+
+  accum += value & accum_mask
+  out = (base & base_mask) + (value & ~accum_mask) + accum
+*/
+
+enum FTEnvParameter {
+  FTENVPARAM_VOLUME   = 0,
+  FTENVPARAM_ARPEGGIO = 1,
+  FTENVPARAM_PITCH    = 2,
+  FTENVPARAM_HIPITCH  = 3,
+  FTENVPARAM_TIMBRE   = 4,
+  FT_NUM_ENVPARAMS    = 5
+};
+
+enum FTArpeggioSense {
+  FTARP_ABSOLUTE = 0,  // offset from the note in the pattern
+  FTARP_FIXED    = 1,  // absolute note
+  FTARP_RELATIVE = 2,  // offset added to the previous tick's offset
+  FTARP_SCHEME   = 3,  // played as absolute for now
+};
+
+#define FTENVPITCH_RELATIVE 0
+#define FTENVPITCH_ABSOLUTE 1
+#define FTENV_NO_RELEASE 0xFFFF
+#define FTENV_MAX_CURSORS (FT_MAX_CHANNELS * 4)
+
+typedef struct FTEnvProgram {
+  int base_mask;  // 0 if the value replaces the base, or -1 if it is added
+  int accum_mask;  // -1 if values accumulate from tick to tick, or 0 if not
+  unsigned char length;  // index of the terminal step
+  unsigned char padding0;
+  unsigned short release_target;  // step to jump to on note release
+  signed char value[FTENV_MAX_TICKS + 1];
+  unsigned char next[FTENV_MAX_TICKS + 1];
+} FTEnvProgram;
+
+/**
+ * An envelope program that always outputs its cursor's base.
+ * Idle cursors point here so that they need no special case.
+ */
+extern const FTEnvProgram FTEnvProgram_none;
+
+/**
+ * Compiles an envelope into a program.
+ * @param out where to write the program
+ * @param env the envelope's steps, loop, release, and sense
+ */
+void FTEnvProgram_compile(FTEnvProgram *restrict out,
+                          const FTEnvelope *restrict env);
+
+/**
+ * Compiles all envelopes in a module.
+ * @return an array of Gap_size(module->all_envelopes) programs
+ * in the same order as module->all_envelopes, which the caller must
+ * free(), or NULL if out of memory
+ */
+FTEnvProgram *FTModule_compile_envelopes(FTModule *module);
+
+/**
+ * Cursors for all envelopes of all channels, in parallel arrays so
+ * that one tick of every cursor is a single loop.  The player sets
+ * base to the note, volume, or other value that an envelope modifies,
+ * and reads the envelope's output from out after each tick.
+ */
+typedef struct FTEnvCursors {
+  const FTEnvProgram *program[FTENV_MAX_CURSORS];
+  unsigned char pos[FTENV_MAX_CURSORS];
+  int base[FTENV_MAX_CURSORS];
+  int accum[FTENV_MAX_CURSORS];
+  int out[FTENV_MAX_CURSORS];
+} FTEnvCursors;
+
+/**
+ * Points all cursors at FTEnvProgram_none with a base of 0.
+ */
+void FTEnvCursors_init(FTEnvCursors *self);
+
+/**
+ * Restarts a cursor from the first step of a program, as on a new
+ * note.
+ * @param program a compiled envelope, or NULL to stop the envelope
+ */
+static inline void FTEnvCursors_start(FTEnvCursors *self, size_t i,
+                                      const FTEnvProgram *program) {
+  self->program[i] = program ? program : &FTEnvProgram_none;
+  self->pos[i] = 0;
+  self->accum[i] = 0;
+}
+
+/**
+ * Jumps a cursor past its program's release point, as on a note
+ * release.  Does nothing if the program has no release point.
+ */
+static inline void FTEnvCursors_release(FTEnvCursors *self, size_t i) {
+  unsigned int target = self->program[i]->release_target;
+  if (target != FTENV_NO_RELEASE) self->pos[i] = target;
+}
+
+/**
+ * Computes the output of the first n cursors for this tick and
+ * moves them to the next step.
+ */
+void FTEnvCursors_tick(FTEnvCursors *self, size_t n);
+
+#endif
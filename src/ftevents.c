@@ -0,0 +1,79 @@
+/*
+compiling a song's order table and patterns into per-track events
+*/
+#include "ftevents.h"
+#include "typedgap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPECTED_EVENTS_PER_TRACK 64
+
+GAPLIST_DEFINE(FTEventGap, FTEvent)
+
+FTEventList *FTEventList_compile(FTSong *song, const FTMetronome *timing) {
+  size_t num_tracks = Gap_size(song->patterns);
+  FTEventList *list = 0;
+  FTEventGap *track_events[FT_MAX_CHANNELS] = {0};
+  if (num_tracks > FT_MAX_CHANNELS) return 0;
+  for (size_t t = 0; t < num_tracks; ++t) {
+    track_events[t] = FTEventGap_new(EXPECTED_EVENTS_PER_TRACK);
+    if (!track_events[t]) goto cleanup;
+  }
+
+  // Look up each track's pattern only when the order row changes
+  const FTPatRow *patterns[FT_MAX_CHANNELS] = {0};
+  size_t patterns_order_row = FTMETRONOME_NONE;
+  for (size_t i = 0; i < timing->num_rows; ++i) {
+    const FTRowTiming *rt = &timing->rows[i];
+    if (rt->order_row != patterns_order_row) {
+      patterns_order_row = rt->order_row;
+      if (FTSong_get_order_patterns(song, patterns_order_row, patterns)
+          < num_tracks) {
+        goto cleanup;
+      }
+    }
+    for (size_t t = 0; t < num_tracks; ++t) {
+      if (!patterns[t] || FTPatRow_is_empty(&patterns[t][rt->row])) continue;
+      const FTPatRow *src = &patterns[t][rt->row];
+
+      FTEvent ev;
+      ev.tick = rt->tick;
+      ev.note = src->note;
+      ev.instrument = src->instrument;
+      ev.volume = src->volume;
+      ev.padding0 = 0;
+      memcpy(ev.effects, src->effects, sizeof ev.effects);
+      if (!FTEventGap_add(track_events[t], ev)) goto cleanup;
+    }
+  }
+
+  // Pack all tracks' events into one allocation
+  size_t total_events = 0;
+  for (size_t t = 0; t < num_tracks; ++t) {
+    total_events += FTEventGap_size(track_events[t]);
+  }
+  size_t header_size = sizeof(FTEventList) + num_tracks * sizeof(FTEventTrack);
+  header_size = (header_size + sizeof(FTEvent) - 1)
+                / sizeof(FTEvent) * sizeof(FTEvent);
+  list = malloc(header_size + total_events * sizeof(FTEvent));
+  if (!list) goto cleanup;
+  list->num_tracks = num_tracks;
+  FTEvent *dst = (FTEvent *)((char *)list + header_size);
+  for (size_t t = 0; t < num_tracks; ++t) {
+    size_t n = FTEventGap_size(track_events[t]);
+    if (n) memcpy(dst, FTEventGap_toArray(track_events[t]), n * sizeof(FTEvent));
+    list->tracks[t].events = dst;
+    list->tracks[t].num_events = n;
+    dst += n;
+  }
+
+cleanup:
+  for (size_t t = 0; t < num_tracks; ++t) {
+    FTEventGap_delete(track_events[t]);
+  }
+  return list;
+}
+
+void FTEventList_delete(FTEventList *list) {
+  free(list);
+}
@@ -0,0 +1,46 @@
+#ifndef FTEVENTS_H
+#define FTEVENTS_H
+#include "ftmodule.h"
+#include "ftmetronome.h"
+
+/*
+A song's patterns are stored the way the tracker edits them: an order
+table of pattern IDs and a grid of rows, most of which are empty.
+An event list flattens one playthrough of a song into a time-sorted
+array of nonempty rows per track, each stamped with the tick at which
+it is played, so that playback can walk each track with a pointer.
+*/
+
+typedef struct {
+  unsigned int tick;  // ticks since the start of the song
+  unsigned char note, instrument, volume, padding0;
+  FTPatEffect effects[FTPAT_MAX_EFFECTS];
+} FTEvent;
+
+typedef struct {
+  const FTEvent *events;  // sorted by tick
+  size_t num_events;
+} FTEventTrack;
+
+typedef struct {
+  size_t num_tracks;
+  FTEventTrack tracks[];
+} FTEventList;
+
+/**
+ * Collects the nonempty rows of each track in the order that a
+ * metronome plays them.  The events of all tracks share one
+ * allocation.
+ * @param song the song to compile
+ * @param timing the song's rows in play order, from FTMetronome_new()
+ * @return an event list that the caller must free with
+ * FTEventList_delete(), or NULL if out of memory
+ */
+FTEventList *FTEventList_compile(FTSong *song, const FTMetronome *timing);
+
+/**
+ * Frees an event list.
+ */
+void FTEventList_delete(FTEventList *list);
+
+#endif
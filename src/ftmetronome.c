@@ -0,0 +1,162 @@
+/*
+timing a song's rows from its speed, tempo, and jump effects
+*/
+#include "ftmetronome.h"
+#include "typedgap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FT_TEMPO_SPLIT 0x20
+
+GAPLIST_DEFINE(FTRowTimingGap, FTRowTiming)
+
+/**
+ * Counts ticks in the row that begins when the tempo accumulator
+ * next falls to zero or below.  FamiTracker adds 60 * tick rate
+ * per row and subtracts 24 * tempo / speed per tick; this scales
+ * both by speed so that fractional row lengths carry exactly into
+ * the next row instead of drifting.
+ * @param accum the tempo accumulator, updated in place
+ */
+static unsigned int row_ticks(long *accum, unsigned int tick_rate,
+                              unsigned int speed, unsigned int tempo) {
+  long decrement = 24L * tempo;
+  *accum += 60L * tick_rate * speed;
+  unsigned int ticks = *accum > 0 ? (*accum + decrement - 1) / decrement : 0;
+  if (ticks < 1) ticks = 1;
+  *accum -= ticks * decrement;
+  return ticks;
+}
+
+FTMetronome *FTMetronome_new(FTModule *module, FTSong *song) {
+  size_t num_order_rows = Gap_size(song->order);
+  size_t rpp = song->rows_per_pattern;
+  size_t num_positions = num_order_rows * rpp;
+  FTMetronome *self = 0;
+
+  size_t *position_index = malloc(num_positions * sizeof(size_t) + 1);
+  FTRowTimingGap *rows = FTRowTimingGap_new(num_positions + 1);
+  if (!position_index || !rows) goto cleanup;
+  for (size_t i = 0; i < num_positions; ++i) {
+    position_index[i] = FTMETRONOME_NONE;
+  }
+
+  unsigned int tick_rate = FTModule_tick_rate(module);
+  unsigned int speed = song->start_speed ? song->start_speed : 1;
+  unsigned int tempo = song->start_tempo ? song->start_tempo : 1;
+  unsigned int tick = 0;
+  size_t loop_index = FTMETRONOME_NONE;
+  long tempo_accum = 0;
+  size_t order_row = 0, row = 0;
+  const FTPatRow *patterns[FT_MAX_CHANNELS];
+  size_t num_tracks = 0, patterns_order_row = FTMETRONOME_NONE;
+  while (order_row < num_order_rows && rpp > 0) {
+    size_t position = order_row * rpp + row;
+    if (position_index[position] != FTMETRONOME_NONE) {
+      loop_index = position_index[position];
+      break;
+    }
+    position_index[position] = FTRowTimingGap_size(rows);
+
+    // Effects that change the song position or speed take effect
+    // on this row regardless of which track they are in
+    if (order_row != patterns_order_row) {
+      num_tracks = FTSong_get_order_patterns(song, order_row, patterns);
+      patterns_order_row = order_row;
+    }
+    int jump_order = -1, skip_row = -1, halt = 0;
+    for (size_t t = 0; t < num_tracks; ++t) {
+      if (!patterns[t]) continue;
+      const FTPatEffect *effects = patterns[t][row].effects;
+      for (size_t j = 0; j < FTPAT_MAX_EFFECTS && effects[j].fx; ++j) {
+        unsigned int value = effects[j].value;
+        switch (effects[j].fx) {
+          case 'F':
+            if (value >= FT_TEMPO_SPLIT) {
+              tempo = value;
+            } else if (value > 0) {
+              speed = value;
+            }
+            break;
+          case 'B': jump_order = value; break;
+          case 'C': halt = 1; break;
+          case 'D': skip_row = value; break;
+        }
+      }
+    }
+
+    FTRowTiming timing = {0};
+    timing.tick = tick;
+    timing.order_row = order_row;
+    timing.row = row;
+    timing.speed = speed;
+    timing.tempo = tempo;
+    if (!FTRowTimingGap_add(rows, timing)) goto cleanup;
+    tick += row_ticks(&tempo_accum, tick_rate, speed, tempo);
+    if (halt) break;
+
+    // Find the next row
+    if (jump_order >= 0 || skip_row >= 0) {
+      order_row = jump_order >= 0 ? (size_t)jump_order : order_row + 1;
+      row = skip_row >= 0 ? (size_t)skip_row : 0;
+      if (order_row >= num_order_rows) order_row = 0;
+      if (row >= rpp) row = 0;
+    } else if (++row >= rpp) {
+      row = 0;
+      if (++order_row >= num_order_rows) order_row = 0;
+    }
+  }
+
+  size_t num_rows = FTRowTimingGap_size(rows);
+  self = malloc(sizeof(FTMetronome) + num_rows * sizeof(FTRowTiming));
+  if (!self) goto cleanup;
+  self->tick_rate = tick_rate;
+  self->length_ticks = tick;
+  self->loop_index = loop_index;
+  self->rows_per_pattern = rpp;
+  self->num_order_rows = num_order_rows;
+  self->position_index = position_index;
+  self->num_rows = num_rows;
+  if (num_rows) {
+    memcpy(self->rows, FTRowTimingGap_toArray(rows),
+           num_rows * sizeof(FTRowTiming));
+  }
+  position_index = 0;
+
+cleanup:
+  FTRowTimingGap_delete(rows);
+  free(position_index);
+  return self;
+}
+
+void FTMetronome_delete(FTMetronome *self) {
+  if (!self) return;
+  free(self->position_index);
+  free(self);
+}
+
+size_t FTMetronome_find_tick(const FTMetronome *self, uint64_t tick) {
+  if (tick >= self->length_ticks || self->num_rows == 0) {
+    return FTMETRONOME_NONE;
+  }
+
+  // Find the last row that begins at or before tick
+  size_t lo = 0, hi = self->num_rows;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (self->rows[mid].tick <= tick) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t FTMetronome_find_row(const FTMetronome *self,
+                            size_t order_row, size_t row) {
+  if (order_row >= self->num_order_rows || row >= self->rows_per_pattern) {
+    return FTMETRONOME_NONE;
+  }
+  return self->position_index[order_row * self->rows_per_pattern + row];
+}
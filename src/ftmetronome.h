@@ -0,0 +1,100 @@
+#ifndef FTMETRONOME_H
+#define FTMETRONOME_H
+#include <stdint.h>
+#include <limits.h>
+#include "ftmodule.h"
+
+/*
+A metronome lists the rows of one playthrough of a song in the order
+they are played, with the tick at which each begins.  Ticks convert
+to output samples with a single multiply and divide, so positions
+at any output rate are exact and do not drift.
+*/
+
+#define FTMETRONOME_NONE SIZE_MAX
+
+typedef struct {
+  unsigned int tick;  // tick at which this row begins
+  unsigned short order_row;
+  unsigned char row;  // row within each track's pattern
+  unsigned char speed;  // ticks per row at tempo 150 and 60 Hz
+  unsigned char tempo;
+  unsigned char padding0[3];
+} FTRowTiming;
+
+typedef struct {
+  unsigned int tick_rate;  // ticks per second
+  unsigned int length_ticks;  // tick at which the song ends or loops
+  size_t loop_index;  // index in rows to jump to at the end, or FTMETRONOME_NONE
+  size_t rows_per_pattern;
+  size_t num_order_rows;
+  size_t *position_index;  // [order_row * rows_per_pattern + row] to index in rows
+  size_t num_rows;
+  FTRowTiming rows[];
+} FTMetronome;
+
+/**
+ * Walks a song's order table and patterns once from the start,
+ * following speed and tempo (Fxx), jump (Bxx), halt (Cxx),
+ * and skip (Dxx) effects, until it halts or reaches a row it has
+ * already played.
+ * @param module the module containing song, for its tick rate
+ * @param song the song to time
+ * @return a metronome that the caller must free with
+ * FTMetronome_delete(), or NULL if out of memory
+ */
+FTMetronome *FTMetronome_new(FTModule *module, FTSong *song);
+
+/**
+ * Frees a metronome.
+ */
+void FTMetronome_delete(FTMetronome *self);
+
+/**
+ * Returns the number of output samples from the start of the song
+ * to the start of a tick.
+ */
+static inline uint64_t FTMetronome_tick_to_sample(const FTMetronome *self,
+                                                  uint64_t tick,
+                                                  unsigned int outrate) {
+  return tick * outrate / self->tick_rate;
+}
+
+/**
+ * Returns the tick being played at an output sample.
+ */
+static inline uint64_t FTMetronome_sample_to_tick(const FTMetronome *self,
+                                                  uint64_t sample,
+                                                  unsigned int outrate) {
+  // The last tick t with t * outrate / tick_rate <= sample
+  return ((sample + 1) * self->tick_rate - 1) / outrate;
+}
+
+/**
+ * Finds the row being played at a tick by binary search.
+ * @return an index into self->rows, or FTMETRONOME_NONE if tick is
+ * at or after the end
+ */
+size_t FTMetronome_find_tick(const FTMetronome *self, uint64_t tick);
+
+/**
+ * Finds the row being played at an output sample.
+ * @return an index into self->rows, or FTMETRONOME_NONE if sample
+ * is at or after the end
+ */
+static inline size_t FTMetronome_find_sample(const FTMetronome *self,
+                                             uint64_t sample,
+                                             unsigned int outrate) {
+  return FTMetronome_find_tick(self,
+                               FTMetronome_sample_to_tick(self, sample, outrate));
+}
+
+/**
+ * Finds where a row of the order table is played.
+ * @return an index into self->rows, or FTMETRONOME_NONE if the
+ * row is never reached
+ */
+size_t FTMetronome_find_row(const FTMetronome *self,
+                            size_t order_row, size_t row);
+
+#endif
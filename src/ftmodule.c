@@ -1,11 +1,16 @@
 #include "ftmodule.h"
+#include "typedmap.h"
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 
 #define EXPECTED_INSTS 16
 #define EXPECTED_ENVS_PER_INST 2
 #define EXPECTED_SONGS 16
 #define EXPECTED_ORDER 16
 #define EXPECTED_PATTERNS 16
+#define FT_NTSC_TICK_RATE 60
+#define FT_PAL_TICK_RATE 50
 
 const char *const FT_expansion_names[FT_NUM_ENVPOOLS] = {
   "VRC6", "VRC7", "FDS", "MMC5", "N163", "YM2149"
@@ -16,16 +21,45 @@ const unsigned char FT_expansion_channels[FT_NUM_ENVPOOLS] = {
   3, 6, 1, 2, 8, 3
 };
 
+// Envelopes are indexed by chipid, parameter, and envid packed
+// into one integer
+#define FTENVKEY(chipid, parameter, envid) \
+  ((uint_least32_t)(chipid) << 16 | (uint_least32_t)(parameter) << 8 \
+   | (uint_least32_t)(envid))
+#define FTENVKEY_HASH(k) (k)
+#define FTENVKEY_EQUAL(a, b) ((a) == (b))
+HASHMAP_DEFINE(FTEnvIndex, uint_least32_t, size_t,
+               FTENVKEY_HASH, FTENVKEY_EQUAL)
+
+static void delete_each_list(void *els, size_t n, void *ctx) {
+  (void)ctx;
+  GapList **lists = els;
+  for (size_t i = 0; i < n; ++i) Gap_delete(lists[i]);
+}
+
+static void free_each(void *els, size_t n, void *ctx) {
+  (void)ctx;
+  void **ptrs = els;
+  for (size_t i = 0; i < n; ++i) free(ptrs[i]);
+}
+
+static void delete_each_instrument(void *els, size_t n, void *ctx) {
+  (void)ctx;
+  FTPSGInstrument *insts = els;
+  for (size_t i = 0; i < n; ++i) Gap_delete(insts[i].wave_ids);
+}
+
+static void unlink_each_song(void *els, size_t n, void *ctx) {
+  (void)ctx;
+  FTSong *songs = els;
+  for (size_t i = 0; i < n; ++i) FTSong_unlink(&songs[i]);
+}
+
 void FTSong_unlink(FTSong *song) {
   if (!song) return;
   free(song->title);
   Gap_delete(song->order);  // a list of fixed-length rows
-  while (!Gap_isEmpty(song->patterns)) {
-    GapList **result = Gap_get(song->patterns, 0);
-    GapList *trackPatterns = *result;
-    Gap_delete(trackPatterns);
-    Gap_remove(song->patterns, 0);
-  }
+  Gap_forEachSpan(song->patterns, delete_each_list, 0);
   Gap_delete(song->patterns);
   song->title = 0;
   song->order = 0;
@@ -59,32 +93,16 @@ void FTModule_delete(FTModule *module) {
   free(module->author);
   free(module->copyright);
   // Delete instruments
-  if (module->instruments) {
-    while (!Gap_isEmpty(module->instruments)) {
-      FTPSGInstrument *ws = Gap_get(module->instruments, 0);
-      Gap_delete(ws->waves);
-      Gap_remove(module->instruments, 0);
-    }
-    Gap_delete(module->instruments);
-  }
+  Gap_forEachSpan(module->instruments, delete_each_instrument, 0);
+  Gap_delete(module->instruments);
   // Delete envelopes
-  if (module->all_envelopes) {
-    while (!Gap_isEmpty(module->all_envelopes)) {
-      FTEnvelope **ws = Gap_get(module->all_envelopes, 0);
-      free(*ws);
-      Gap_remove(module->all_envelopes, 0);
-    }
-    Gap_delete(module->all_envelopes);
-  }
+  Gap_forEachSpan(module->all_envelopes, free_each, 0);
+  Gap_delete(module->all_envelopes);
+  FTEnvIndex_delete(module->envelope_index);
   // Delete songs
-  if (module->songs) {
-    while (!Gap_isEmpty(module->songs)) {
-      FTSong *song = Gap_get(module->songs, 0);
-      FTSong_unlink(song);
-      Gap_remove(module->songs, 0);
-    }
-    Gap_delete(module->songs);
-  }
+  Gap_forEachSpan(module->songs, unlink_each_song, 0);
+  Gap_delete(module->songs);
+  FTWaveBank_delete(module->waves);
   free(module);
 }
 
@@ -95,18 +113,29 @@ FTModule *FTModule_new(void) {
   module->title = 0;
   module->author = 0;
   module->copyright = 0;
+  module->waves = 0;
+  module->envelope_index = 0;
   // Allocate dynamic arrays
   module->instruments = Gap_new(sizeof(FTPSGInstrument), EXPECTED_INSTS);
   module->all_envelopes
     = Gap_new(sizeof(FTEnvelope *), EXPECTED_INSTS * EXPECTED_ENVS_PER_INST);
+  module->envelope_index
+    = FTEnvIndex_new(EXPECTED_INSTS * EXPECTED_ENVS_PER_INST);
   module->songs = Gap_new(sizeof(FTSong), EXPECTED_SONGS);
-  if (!module->songs || !module->instruments || !module->all_envelopes) {
+  module->waves = FTWaveBank_new();
+  if (!module->songs || !module->instruments || !module->all_envelopes
+      || !module->envelope_index || !module->waves) {
     FTModule_delete(module);
     return 0;
   }
   return module;
 }
 
+unsigned int FTModule_tick_rate(const FTModule *module) {
+  if (module->tickRate) return module->tickRate;
+  return module->tvSystem ? FT_PAL_TICK_RATE : FT_NTSC_TICK_RATE;
+}
+
 size_t FTModule_count_channels(unsigned int expansion) {
   size_t count = FT_2A03_NUM_CHANNELS;
   for (size_t i = 0; i < FT_NUM_ENVPOOLS; ++i) {
@@ -125,16 +154,67 @@ FTPSGInstrument *FTModule_get_instrument(FTModule *module, size_t instid) {
   return Gap_get(module->instruments, instid);
 }
 
-unsigned char *FTModule_get_wave(FTModule *module, size_t instid,
-                                 size_t waveid, size_t *elSize) {
+int FTModule_add_envelope(FTModule *module, FTEnvelope *env) {
+  size_t dedupeid = Gap_size(module->all_envelopes);
+  uint_least32_t key = FTENVKEY(env->chipid, env->parameter, env->envid);
+  if (!Gap_add(module->all_envelopes, &env)) {
+    free(env);
+    return -1;
+  }
+  if (!FTEnvIndex_get(module->envelope_index, key)
+      && !FTEnvIndex_put(module->envelope_index, key, dedupeid)) {
+    Gap_removeBefore(module->all_envelopes, 1);
+    free(env);
+    return -1;
+  }
+  return 0;
+}
+
+size_t FTModule_find_envelope(FTModule *module, unsigned int chipid,
+                              unsigned int parameter, unsigned int envid) {
+  if (chipid > UCHAR_MAX || parameter > UCHAR_MAX || envid > UCHAR_MAX) {
+    return SIZE_MAX;
+  }
+  const size_t *dedupeid = FTEnvIndex_get(
+    module->envelope_index, FTENVKEY(chipid, parameter, envid)
+  );
+  return dedupeid ? *dedupeid : SIZE_MAX;
+}
+
+unsigned int FTModule_set_wave(FTModule *module, size_t instid,
+                               size_t waveid, const unsigned char *samples) {
   FTPSGInstrument *inst = FTModule_get_instrument(module, instid);
-  if (!inst || !inst->waves) return 0;
-  static const char null_wave[FTN163_MAX_WAVE];
-  while (Gap_size(inst->waves) <= waveid) {
-    if (!Gap_add(inst->waves, null_wave)) return 0;
+  if (!inst || !inst->wave_ids || waveid >= FTN163_MAX_WAVE_COUNT
+      || inst->waveram_length > FTN163_MAX_WAVE) {
+    return FTWAVE_NONE;
+  }
+  unsigned int id = FTWaveBank_intern(module->waves, samples,
+                                      inst->waveram_length);
+  if (id == FTWAVE_NONE) return FTWAVE_NONE;
+  static const unsigned short null_wave_id = FTWAVE_NONE;
+  while (Gap_size(inst->wave_ids) <= waveid) {
+    if (!Gap_add(inst->wave_ids, &null_wave_id)) return FTWAVE_NONE;
+  }
+  unsigned short id_short = id;
+  Gap_set(inst->wave_ids, waveid, &id_short);
+  return id;
+}
+
+size_t FTSong_get_order_patterns(FTSong *song, size_t order_row,
+                                 const FTPatRow **out) {
+  const unsigned char *pattern_ids = Gap_get(song->order, order_row);
+  if (!pattern_ids) return 0;
+  GapSpans tracks = Gap_spans(song->patterns);
+  GapList **track_patterns = tracks.before;
+  size_t t = 0;
+  for (size_t i = 0; i < tracks.nBefore && t < FT_MAX_CHANNELS; ++i, ++t) {
+    out[t] = Gap_get(track_patterns[i], pattern_ids[t]);
+  }
+  track_patterns = tracks.after;
+  for (size_t i = 0; i < tracks.nAfter && t < FT_MAX_CHANNELS; ++i, ++t) {
+    out[t] = Gap_get(track_patterns[i], pattern_ids[t]);
   }
-  if (elSize) *elSize = Gap_elSize(inst->waves);
-  return Gap_get(inst->waves, waveid);
+  return t;
 }
 
 FTPatRow *FTSong_get_row(FTSong *song, size_t track,
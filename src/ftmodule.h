@@ -1,11 +1,13 @@
 #ifndef FTMODULE_H
 #define FTMODULE_H
 #include "gaplist.h"
+#include "ftwavebank.h"
 
 // Instruments //////////////////////////////////////////////////////
 
 #define FTENV_MAX_TICKS 255
 #define FTN163_MAX_WAVE 240
+#define FTN163_MAX_WAVE_COUNT 64  // waves per N163 instrument
 
 enum FTEnvPoolID {
   FTENVPOOL_VRC6   = 0,
@@ -32,10 +34,11 @@ typedef struct {
   unsigned char envid_timbre;
 
   // ancillary data for each instrument
-  // for N163, waves is a GapList<char[waveram_length]>
+  // for N163, wave_ids is a GapList<unsigned short> of IDs in the
+  // module's wave bank, each waveram_length samples long
   unsigned char waveram_length;
   unsigned char waveram_address;
-  GapList *waves;
+  GapList *wave_ids;
 } FTPSGInstrument;
 
 typedef struct {
@@ -78,6 +81,15 @@ typedef struct {
   FTPatEffect effects[FTPAT_MAX_EFFECTS];
 } FTPatRow;
 
+/**
+ * Tests whether a pattern row has no note, instrument, volume,
+ * or effect.
+ */
+static inline int FTPatRow_is_empty(const FTPatRow *row) {
+  return row->note == FTNOTE_WAIT && row->instrument == FTINST_NONE
+         && row->volume == FTVOLCOL_NONE && row->effects[0].fx == 0;
+}
+
 // Top level ////////////////////////////////////////////////////////
 
 typedef struct {
@@ -102,7 +114,8 @@ typedef struct {
   GapList *instruments;  // GapList<FTPSGInstrument> psg_instruments[instid]
   GapList *all_envelopes;  // GapList<FTEnvelope *> all_envelopes[dedupeid]
   GapList *songs;  // GapList<FTSong> songs[songid];
-  // TODO: come up with a solution for envelope lookup
+  FTWaveBank *waves;  // N163 waves of all instruments
+  struct FTEnvIndex *envelope_index;  // envelope key -> dedupeid
 } FTModule;
 
 
@@ -129,6 +142,12 @@ void FTModule_delete(FTModule *module);
  */
 FTModule *FTModule_new(void);
 
+/**
+ * Returns the number of ticks per second that a module's tempo is
+ * based on: its custom update rate or the default for the machine.
+ */
+unsigned int FTModule_tick_rate(const FTModule *module);
+
 /**
  * Counts channels corresponding to a set of enabled expansions.
  */
@@ -141,12 +160,50 @@ size_t FTModule_count_channels(unsigned int expansion);
 FTPSGInstrument *FTModule_get_instrument(FTModule *module, size_t instid);
 
 /**
- * Inserts blank waves into instrument instid until at least waveid+1
- * waves are present then returns Gap_get(waves, waveid).
- * @param elSize if not null, the size of each wave is written here
+ * Adds an envelope to a module and indexes it by its key.  If an
+ * envelope with the same key is already present, the new one is
+ * kept but FTModule_find_envelope() still finds the first.
+ * @param env an envelope allocated with malloc(), which the module
+ * owns from now on, even if this fails
+ * @return 0 if successful or -1 if out of memory
+ */
+int FTModule_add_envelope(FTModule *module, FTEnvelope *env);
+
+/**
+ * Finds an envelope by its key.
+ * @param chipid one of FTENVPOOL_*
+ * @param parameter 0: volume; 1: arpeggio; 2: pitch; 3: hi-pitch; 4: timbre
+ * @param envid the ID used by instruments, or UCHAR_MAX for none
+ * @return the envelope's index in module->all_envelopes, or
+ * SIZE_MAX if no envelope has this key
+ */
+size_t FTModule_find_envelope(FTModule *module, unsigned int chipid,
+                              unsigned int parameter, unsigned int envid);
+
+/**
+ * Adds a wave to the module's wave bank, then inserts FTWAVE_NONE
+ * into instrument instid's wave IDs until at least waveid+1 are
+ * present and sets wave waveid to the bank's ID for the wave.
+ * @param samples waveram_length samples in the range 0 to 255
+ * @return the wave's ID in the bank, or FTWAVE_NONE if the
+ * instrument has no waves, its waveram_length exceeds
+ * FTN163_MAX_WAVE, waveid is not below FTN163_MAX_WAVE_COUNT, or out
+ * of memory
+ */
+unsigned int FTModule_set_wave(FTModule *module, size_t instid,
+                               size_t waveid, const unsigned char *samples);
+
+/**
+ * Looks up the pattern that each track plays at a row of the order
+ * table, without inserting blank patterns.
+ * @param out where to write the address of row 0 of each track's
+ * pattern, or NULL for a pattern with no rows stored
+ * (room for FT_MAX_CHANNELS pointers)
+ * @return the number of tracks written, at most FT_MAX_CHANNELS,
+ * or 0 if order_row is out of range
  */
-unsigned char *FTModule_get_wave(FTModule *module, size_t instid,
-                                 size_t waveid, size_t *elSize);
+size_t FTSong_get_order_patterns(FTSong *song, size_t order_row,
+                                 const FTPatRow **out);
 
 /**
  * Inserts blank patterns into a track of a song until at least
@@ -383,7 +383,7 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
           break;
         }
         FTEnvelope *macro = FTModule_pack_env(macro_header, macro_data, nvalues);
-        if (!macro || !Gap_add(module->all_envelopes, &macro)) {
+        if (!macro || FTModule_add_envelope(module, macro) < 0) {
           fprintf(stderr, "%s:%zu: %s: out of memory\n", filename, linenum, kw->name);
           break;
         }
@@ -400,7 +400,7 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
         }
         FTEnvelope *macro = FTModule_pack_env(macro_header, macro_data, nvalues);
         if (macro) macro->chipid = FTENVPOOL_N163;
-        if (!macro || !Gap_add(module->all_envelopes, &macro)) {
+        if (!macro || FTModule_add_envelope(module, macro) < 0) {
           fprintf(stderr, "%s:%zu: %s: out of memory\n", filename, linenum, kw->name);
           break;
         }
@@ -445,10 +445,15 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
         inst->envid_arpeggio = params[2];
         inst->envid_pitch = params[3];
         inst->envid_timbre = params[5];
+        if (params[6] < 1 || params[6] > FTN163_MAX_WAVE) {
+          fprintf(stderr, "%s:%zu: %s: wave length %ld out of range (expected 1 to %d)\n", filename, linenum, kw->name, params[6], FTN163_MAX_WAVE);
+          params[6] = params[6] < 1 ? 1 : FTN163_MAX_WAVE;
+        }
         inst->waveram_length = params[6];
         inst->waveram_address = params[7];
-        inst->waves = Gap_new(inst->waveram_length, params[8]);
-        if (!inst) {
+        inst->wave_ids = Gap_new(sizeof(unsigned short), params[8]);
+        if (!inst->wave_ids
+            || !FTWaveBank_reserve(module->waves, params[8])) {
           fprintf(stderr, "%s:%zu: %s: out of memory for instrument %ld's waves\n", filename, linenum, kw->name, params[0]);
         }
       } break;
@@ -463,6 +468,19 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
           fprintf(stderr, "%s:%zu: %s: expected 2 params\n", filename, linenum, kw->name);
           break;
         }
+
+        // Report a bad instrument or wave index as such, so that
+        // FTWAVE_NONE from FTModule_set_wave() means out of memory
+        FTPSGInstrument *inst = wave_header[0] < 0 ? 0
+                                : Gap_get(module->instruments, wave_header[0]);
+        if (!inst || !inst->wave_ids) {
+          fprintf(stderr, "%s:%zu: %s: no such N163 instrument %ld\n", filename, linenum, kw->name, wave_header[0]);
+          break;
+        }
+        if (wave_header[1] < 0 || wave_header[1] >= FTN163_MAX_WAVE_COUNT) {
+          fprintf(stderr, "%s:%zu: %s: no such wave %ld (expected 0 to %d)\n", filename, linenum, kw->name, wave_header[1], FTN163_MAX_WAVE_COUNT - 1);
+          break;
+        }
         linepos = str_end;
         while (*linepos && isspace(*linepos)) ++linepos;  // eat colon
         if (*linepos++ != ':') {
@@ -475,14 +493,19 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
           break;
         }
 
-        size_t max_nvalues = 0;
-        unsigned char *wave = FTModule_get_wave(module, wave_header[0], wave_header[1], &max_nvalues);
-        if (!wave) {
+        // Expand 4-bit samples to the mixer's 8-bit range once here
+        // so that playback never rescales them
+        unsigned char wave[FTN163_MAX_WAVE] = {0};
+        for (size_t i = 0; i < nvalues; ++i) {
+          long sample = wave_data[i];
+          if (sample < 0) sample = 0;
+          if (sample > 15) sample = 15;
+          wave[i] = sample * 17;
+        }
+        if (FTModule_set_wave(module, wave_header[0], wave_header[1], wave)
+            == FTWAVE_NONE) {
           fprintf(stderr, "%s:%zu: %s: out of memory for instrument %ld wave %ld\n", filename, linenum, kw->name, wave_header[0], wave_header[1]);
         }
-        for (size_t i = 0; i < nvalues && i < max_nvalues; ++i) {
-          wave[i] = wave_data[i];
-        }
       } break;
 
       // These are stateful
@@ -584,8 +607,7 @@ FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename) {
         for (size_t i = 0;
              i < (unsigned)nvalues && i < Gap_size(cur_song->patterns);
              ++i) {
-          if (row[i].note == FTNOTE_WAIT && row[i].instrument == FTINST_NONE
-              && row[i].volume == FTVOLCOL_NONE && row[i].effects[0].fx == 0) {
+          if (FTPatRow_is_empty(&row[i])) {
             continue;  // skip completely empty rows
           }
 
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "ftkeywords.h"
 #include "ftmodule.h"
+#include "ftevents.h"
 
 FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename);
 
@@ -46,6 +47,61 @@ void hexdump(const void *restrict start, size_t length, FILE *restrict fp) {
   if (chars_this_line) fputc('\n', fp);
 }
 
+typedef struct {
+  FTModule *module;
+  size_t index;  // of the first element of the next span
+  size_t elSize;
+} DumpContext;
+
+void dump_envelopes(void *els, size_t n, void *ctx) {
+  DumpContext *dc = ctx;
+  FTEnvelope **envs = els;
+  for (size_t i = 0; i < n; ++i, ++dc->index) {
+    const FTEnvelope *env = envs[i];
+    if (!env) {
+      fprintf(stderr, "ouch! all_envelopes[%zu] is null\n", dc->index);
+      continue;
+    }
+    printf("chip %s %s macro %d with %d steps\n",
+           FT_expansion_names[env->chipid], FT_parameter_names[env->parameter],
+           env->envid, env->env_length);
+    hexdump(env->env_data, env->env_length, stdout);
+  }
+}
+
+void dump_instruments(void *els, size_t n, void *ctx) {
+  DumpContext *dc = ctx;
+  FTPSGInstrument *insts = els;
+  for (size_t i = 0; i < n; ++i, ++dc->index) {
+    FTPSGInstrument *inst = &insts[i];
+    printf("%s instrument %zu with volume env %d, arpeggio env %d, pitch env %d, timbre %d\n",
+           FT_expansion_names[inst->chipid], dc->index, inst->envid_volume, inst->envid_arpeggio, inst->envid_pitch, inst->envid_timbre);
+    GapSpans ids = Gap_spans(inst->wave_ids);
+    for (size_t w = 0; w < ids.nBefore + ids.nAfter; ++w) {
+      unsigned int id = w < ids.nBefore
+                        ? ((unsigned short *)ids.before)[w]
+                        : ((unsigned short *)ids.after)[w - ids.nBefore];
+      const FTWave *wave = FTWaveBank_get(dc->module->waves, id);
+      if (!wave) {
+        printf("wave %zu: none\n", w);
+        continue;
+      }
+      printf("wave %zu: bank wave %u\n", w, id);
+      hexdump(wave->data, wave->length, stdout);
+    }
+  }
+}
+
+void dump_order_rows(void *els, size_t n, void *ctx) {
+  DumpContext *dc = ctx;
+  const unsigned char *order_row = els;
+  for (size_t i = 0; i < n; ++i, ++dc->index) {
+    printf("order row $%02zu: ", dc->index);
+    hexdump(order_row, dc->elSize, stdout);
+    order_row += dc->elSize;
+  }
+}
+
 void FTModule_dump(FTModule *module) {
   puts(module->tvSystem ? "For 2A07 (PAL NES)" : "For 2A03 (NTSC NES)");
   if (module->tickRate) {
@@ -60,29 +116,12 @@ void FTModule_dump(FTModule *module) {
     printf("First %u of 8 N163 channels are used\n", module->wsgNumChannels);
   }
 
-  for (size_t i = 0; i < Gap_size(module->all_envelopes); ++i) {
-    FTEnvelope **result = Gap_get(module->all_envelopes, i);
-    if (!result || !*result) {
-      fprintf(stderr, "ouch! all_envelopes[%zu] is null\n", i);
-      continue;
-    }
-    FTEnvelope *env = *result;
-    printf("chip %s %s macro %d with %d steps\n",
-           FT_expansion_names[env->chipid], FT_parameter_names[env->parameter],
-           env->envid, env->env_length);
-    hexdump(env->env_data, env->env_length, stdout);
-  }
+  DumpContext env_ctx = {module, 0, 0};
+  Gap_forEachSpan(module->all_envelopes, dump_envelopes, &env_ctx);
 
-  for (size_t i = 0; i < Gap_size(module->instruments); ++i) {
-    FTPSGInstrument *inst = Gap_get(module->instruments, i);
-    printf("%s instrument %zu with volume env %d, arpeggio env %d, pitch env %d, timbre %d\n",
-           FT_expansion_names[inst->chipid], i, inst->envid_volume, inst->envid_arpeggio, inst->envid_pitch, inst->envid_timbre);
-    if (inst->waves) {
-      for (size_t w = 0; w < Gap_size(inst->waves); ++w) {
-        hexdump(Gap_get(inst->waves, w), Gap_elSize(inst->waves), stdout);
-      }
-    }
-  }
+  DumpContext inst_ctx = {module, 0, 0};
+  Gap_forEachSpan(module->instruments, dump_instruments, &inst_ctx);
+  printf("%zu distinct waves in wave bank\n", FTWaveBank_size(module->waves));
 
   for (size_t i = 0; i < Gap_size(module->songs); ++i) {
     FTSong *s = Gap_get(module->songs, i);
@@ -90,11 +129,27 @@ void FTModule_dump(FTModule *module) {
     printf("song %zu: %u rows per pattern, speed %u, tempo %u, %zu order rows\n",
            i + 1U, s->rows_per_pattern, s->start_speed, s->start_tempo,
            Gap_size(s->order));
-    for (size_t r = 0; r < Gap_size(s->order); ++r) {
-      const unsigned char *order_row = Gap_get(s->order, r);
-      printf("order row $%02zu: ", r);
-      hexdump(order_row, Gap_elSize(s->order), stdout);
+    FTMetronome *timing = FTMetronome_new(module, s);
+    FTEventList *events = timing ? FTEventList_compile(s, timing) : 0;
+    if (events) {
+      size_t num_events = 0;
+      for (size_t t = 0; t < events->num_tracks; ++t) {
+        num_events += events->tracks[t].num_events;
+      }
+      printf("song %zu: %zu events in %zu rows, %u ticks, %.3f s", i + 1U,
+             num_events, timing->num_rows, timing->length_ticks,
+             (double)timing->length_ticks / timing->tick_rate);
+      if (timing->loop_index != FTMETRONOME_NONE) {
+        const FTRowTiming *loop_row = &timing->rows[timing->loop_index];
+        printf(", looping to order row %u row %u at tick %u",
+               loop_row->order_row, loop_row->row, loop_row->tick);
+      }
+      putchar('\n');
     }
+    FTEventList_delete(events);
+    FTMetronome_delete(timing);
+    DumpContext order_ctx = {module, 0, Gap_elSize(s->order)};
+    Gap_forEachSpan(s->order, dump_order_rows, &order_ctx);
     for (size_t t = 0; t < Gap_size(s->patterns); ++t) {
       GapList *track_patterns = *(GapList **)Gap_get(s->patterns, t);
       printf("song %zu track %zu has %zu patterns\n",
@@ -0,0 +1,197 @@
+/* to build:
+gcc -Wall -Wextra -Os -fsanitize=address -o ftplay ftplay_main.c ftplayer.c ftsegcache.c fteffects.c ftparse.c ftmodule.c ftevents.c ftmetronome.c ftenvelope.c ftwavebank.c gaplist.c hashmap.c allocator.c mixer.c wavecache.c pitchtable.c canonwav.c ../build/ftkeywords.c -lm
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ftplayer.h"
+#include "ftsegcache.h"
+#include "canonwav.h"
+
+FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename);
+
+#define OUTRATE 48000
+
+void print_stats(const FTPlayerStats *stats, double seconds) {
+  printf("%u ticks, %llu samples", stats->length_ticks,
+         (unsigned long long)stats->length_samples);
+  if (stats->loops) {
+    printf(", looping to tick %u, sample %llu", stats->loop_tick,
+           (unsigned long long)stats->loop_sample);
+  }
+  printf("; up to %zu voices; dry run took %.0f us\n",
+         stats->peak_voices, seconds * 1e6);
+  for (size_t c = 0; c < stats->num_channels; ++c) {
+    const FTPlayerChannelStats *ch = &stats->channels[c];
+    printf("track %zu: %lu notes, heard for %lu ticks\n",
+           ch->track + 1, ch->notes, ch->ticks_heard);
+  }
+}
+
+/**
+ * Renders a looping song's intro, num_loops passes through its loop,
+ * and a fade.
+ * @return 0 if successful or nonzero if out of memory
+ */
+int export_loops(FTPlayer *player, WAVEWRITER *out, unsigned int num_loops,
+                 double fade_seconds) {
+  uint64_t fade_samples = fade_seconds * OUTRATE;
+  uint64_t length = FTPlayer_loops_length(player, num_loops, fade_samples);
+  short *pcm = length <= SIZE_MAX / sizeof(short)
+               ? malloc(length * sizeof(short)) : 0;
+  if (!pcm) {
+    FTPlayer_stop(player);
+    fputs("out of memory for looped export\n", stderr);
+    return -1;
+  }
+  uint64_t reused = 0;
+  length = FTPlayer_render_loops(player, pcm, num_loops, fade_samples,
+                                 &reused);
+  wavewriter_write(pcm, length, out);
+  free(pcm);
+  printf("%u loops and %.1f s fade: %llu samples, %llu copied from an earlier pass\n",
+         num_loops, fade_seconds, (unsigned long long)length,
+         (unsigned long long)reused);
+  return 0;
+}
+
+/**
+ * Renders one playthrough of a song through a segment cache.
+ * @return 0 if successful or nonzero if out of memory
+ */
+int export_cached(FTPlayer *player, FTSong *song, WAVEWRITER *out,
+                  uint64_t length, size_t cache_bytes) {
+  FTSegmentCache *segcache = FTSegmentCache_new(song, cache_bytes);
+  short *pcm = length <= SIZE_MAX / sizeof(short)
+               ? malloc(length * sizeof(short)) : 0;
+  if (!segcache || !pcm) {
+    FTSegmentCache_delete(segcache);
+    free(pcm);
+    FTPlayer_stop(player);
+    fputs("out of memory for segment cache\n", stderr);
+    return -1;
+  }
+  clock_t start_time = clock();
+  length = FTPlayer_render_segments(player, segcache, pcm, length);
+  double seconds = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+  FTPlayer_stop(player);
+  wavewriter_write(pcm, length, out);
+  free(pcm);
+
+  FTSegmentCacheStats stats;
+  FTSegmentCache_stats(segcache, &stats);
+  printf("rendered %llu samples in %.0f us; segment cache %lu of %lu hit (%.1f%%), "
+         "%zu segments in %zu bytes, %lu evicted\n",
+         (unsigned long long)length, seconds * 1e6, stats.hits, stats.lookups,
+         stats.lookups ? 100.0 * stats.hits / stats.lookups : 0.0,
+         stats.num_segments, stats.bytes, stats.evictions);
+  FTSegmentCache_delete(segcache);
+  return 0;
+}
+
+/**
+ * Plays one playthrough of a song to a wave file, or with num_loops,
+ * its loop that many times and a fade.
+ * @return 0 if successful, or nonzero if out of memory or unable to
+ * write the file
+ */
+int play_song(FTModule *module, FTSong *song, const FTEnvProgram *programs,
+              const char *outfilename, unsigned int num_loops,
+              double fade_seconds, size_t cache_bytes) {
+  FTMetronome *metronome = FTMetronome_new(module, song);
+  FTEventList *events = metronome ? FTEventList_compile(song, metronome) : 0;
+  FTPlayer *player = malloc(sizeof(FTPlayer));
+  WtMixer *mixer = malloc(sizeof(WtMixer));
+  WAVEWRITER *out = 0;
+  int result = -1;
+  if (!events || !player || !mixer) goto cleanup;
+  out = wavewriter_open(outfilename);
+  if (!out) {
+    perror(outfilename);
+    goto cleanup;
+  }
+  wavewriter_setrate(out, OUTRATE);
+  wavewriter_setchannels(out, 1);
+  wavewriter_setdepth(out, 16);
+
+  WtWaveCache cache;
+  WtWaveCache_init(&cache);
+  FTPlayerStats stats;
+  FTPlayer_init(player, module, metronome, events, programs,
+                mixer, &cache, OUTRATE);
+  clock_t start_time = clock();
+  FTPlayer_dry_run(player, &stats);
+  print_stats(&stats, (double)(clock() - start_time) / CLOCKS_PER_SEC);
+
+  FTPlayer_init(player, module, metronome, events, programs,
+                mixer, &cache, OUTRATE);
+  if (num_loops) {
+    result = export_loops(player, out, num_loops, fade_seconds);
+    goto cleanup;
+  }
+  if (cache_bytes) {
+    result = export_cached(player, song, out, stats.length_samples,
+                           cache_bytes);
+    goto cleanup;
+  }
+  uint64_t samples_left = stats.length_samples;
+  while (samples_left > 0) {
+    short outbuf[1024];
+    size_t n = samples_left < 1024 ? samples_left : 1024;
+    n = FTPlayer_render(player, outbuf, n);
+    if (n == 0) break;
+    wavewriter_write(outbuf, n, out);
+    samples_left -= n;
+  }
+  FTPlayer_stop(player);
+  printf("played %llu ticks in %llu samples; wave cache %lu hits, %lu misses\n",
+         (unsigned long long)player->ticks_played,
+         (unsigned long long)player->samples_played,
+         cache.hits, cache.misses);
+  result = 0;
+
+cleanup:
+  if (out) wavewriter_close(out);
+  free(mixer);
+  free(player);
+  FTEventList_delete(events);
+  FTMetronome_delete(metronome);
+  return result;
+}
+
+// Driver program ///////////////////////////////////////////////////
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "parsertest.txt";
+  const char *outfilename = argc > 2 ? argv[2] : "out.wav";
+  unsigned int num_loops = argc > 3 ? strtoul(argv[3], 0, 10) : 0;
+  double fade_seconds = argc > 4 ? strtod(argv[4], 0) : 0;
+  size_t cache_bytes = argc > 5 ? strtoul(argv[5], 0, 10) * 1024 : 0;
+
+  FILE *infp = fopen(filename, "r");
+  if (!infp) {
+    perror(filename);
+    return EXIT_FAILURE;
+  }
+  FTModule *module = FTModule_fromtxt(infp, filename);
+  fclose(infp);
+  if (!module) {
+    fprintf(stderr, "%s: error loading\n", filename);
+    return EXIT_FAILURE;
+  }
+  FTSong *song = Gap_get(module->songs, 0);
+  FTEnvProgram *programs = FTModule_compile_envelopes(module);
+  int result = EXIT_FAILURE;
+  if (!song) {
+    fprintf(stderr, "%s: no songs\n", filename);
+  } else if (!programs && Gap_size(module->all_envelopes)) {
+    fputs("out of memory compiling envelopes\n", stderr);
+  } else if (play_song(module, song, programs, outfilename,
+                       num_loops, fade_seconds, cache_bytes) == 0) {
+    result = 0;
+  }
+  free(programs);
+  FTModule_delete(module);
+  return result;
+}
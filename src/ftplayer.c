@@ -0,0 +1,751 @@
+/*
+playing a song's events through the wavetable mixer
+*/
+#include "ftplayer.h"
+#include "ftsegcache.h"
+#include <string.h>
+
+#define FTPLAYER_NO_WAVE (-1)
+#define FTPLAYER_MAX_VOLUME 15
+
+static const unsigned char slot_parameters[FTPLAYER_NUM_ENV_SLOTS] = {
+  FTENVPARAM_VOLUME, FTENVPARAM_ARPEGGIO, FTENVPARAM_PITCH, FTENVPARAM_TIMBRE
+};
+
+#define FTPLAYER_PULSE_LENGTH 8
+#define FTPLAYER_TRIANGLE_LENGTH 32
+
+// Pulse waves of duty 12.5%, 25%, 50%, and 75%, then a triangle
+static const uint8_t builtin_waves[] = {
+  255,   0,   0,   0,   0,   0,   0,   0,
+  255, 255,   0,   0,   0,   0,   0,   0,
+  255, 255, 255, 255,   0,   0,   0,   0,
+  255, 255, 255, 255, 255, 255,   0,   0,
+  255, 238, 221, 204, 187, 170, 153, 136, 119, 102, 85, 68, 51, 34, 17, 0,
+  0, 17, 34, 51, 68, 85, 102, 119, 136, 153, 170, 187, 204, 221, 238, 255,
+};
+static const unsigned char builtin_lengths[FTPLAYER_NUM_BUILTIN_WAVES] = {
+  FTPLAYER_PULSE_LENGTH, FTPLAYER_PULSE_LENGTH, FTPLAYER_PULSE_LENGTH,
+  FTPLAYER_PULSE_LENGTH, FTPLAYER_TRIANGLE_LENGTH
+};
+
+// The chip whose instruments each kind of channel plays
+static const unsigned char kind_chipids[] = {
+  FTENVPOOL_N163, FTENVPOOL_2A03, FTENVPOOL_2A03
+};
+
+// The 2A03 tracks that are played, in order
+static const unsigned char kinds_2a03[] = {
+  FTPLAYER_PULSE, FTPLAYER_PULSE, FTPLAYER_TRIANGLE
+};
+
+static int clamp(int value, int lo, int hi) {
+  return value < lo ? lo : value > hi ? hi : value;
+}
+
+/**
+ * Finds the compiled envelopes that each 2A03 and N163 instrument
+ * uses.
+ */
+static void find_instrument_envelopes(FTPlayer *self,
+                                      const FTEnvProgram *programs) {
+  size_t num_instruments = Gap_size(self->module->instruments);
+  for (size_t i = 0; i < FTPLAYER_MAX_INSTRUMENTS; ++i) {
+    const FTPSGInstrument *inst = i < num_instruments
+                                  ? Gap_get(self->module->instruments, i) : 0;
+    const unsigned char envids[FTPLAYER_NUM_ENV_SLOTS] = {
+      inst ? inst->envid_volume : UCHAR_MAX,
+      inst ? inst->envid_arpeggio : UCHAR_MAX,
+      inst ? inst->envid_pitch : UCHAR_MAX,
+      inst ? inst->envid_timbre : UCHAR_MAX,
+    };
+    for (size_t slot = 0; slot < FTPLAYER_NUM_ENV_SLOTS; ++slot) {
+      size_t index = SIZE_MAX;
+      if (inst && (inst->chipid == FTENVPOOL_N163
+                   || inst->chipid == FTENVPOOL_2A03)
+          && envids[slot] != UCHAR_MAX) {
+        index = FTModule_find_envelope(self->module, inst->chipid,
+                                       slot_parameters[slot], envids[slot]);
+      }
+      self->instrument_envelopes[i][slot]
+        = index != SIZE_MAX ? &programs[index] : 0;
+    }
+  }
+}
+
+void FTPlayer_init(FTPlayer *self, FTModule *module,
+                   const FTMetronome *metronome, const FTEventList *events,
+                   const FTEnvProgram *programs, WtMixer *mixer,
+                   WtWaveCache *cache, unsigned int outrate) {
+  self->module = module;
+  self->metronome = metronome;
+  self->events = events;
+  self->mixer = mixer;
+  self->cache = cache;
+  self->outrate = outrate;
+  self->tick = 0;
+  self->ticks_played = 0;
+  self->samples_played = 0;
+  self->next_tick_sample = 0;
+  WtTickClock_init(&self->clock, outrate, metronome->tick_rate);
+  self->ended = metronome->num_rows == 0;
+
+  // N163 tracks follow those of the 2A03 and of each expansion
+  // before it in FT_expansion_names
+  size_t num_channels = 0;
+  int plays_2a03 = 0;
+  for (size_t t = 0; t < sizeof kinds_2a03 && t < events->num_tracks; ++t) {
+    self->channels[num_channels].track = t;
+    self->channels[num_channels].kind = kinds_2a03[t];
+    ++num_channels;
+    if (events->tracks[t].num_events) plays_2a03 = 1;
+  }
+  if (module->expansion & (1 << FTENVPOOL_N163)) {
+    size_t first_track = FT_2A03_NUM_CHANNELS;
+    for (size_t i = 0; i < FTENVPOOL_N163; ++i) {
+      if (module->expansion & (1 << i)) {
+        first_track += FT_expansion_channels[i];
+      }
+    }
+    size_t num_n163 = module->wsgNumChannels;
+    if (num_n163 > FT_expansion_channels[FTENVPOOL_N163]) {
+      num_n163 = FT_expansion_channels[FTENVPOOL_N163];
+    }
+    for (size_t i = 0; i < num_n163; ++i) {
+      if (first_track + i >= events->num_tracks
+          || num_channels >= FTPLAYER_MAX_CHANNELS) {
+        break;
+      }
+      self->channels[num_channels].track = first_track + i;
+      self->channels[num_channels].kind = FTPLAYER_N163;
+      ++num_channels;
+    }
+  }
+  self->num_channels = num_channels;
+
+  for (size_t c = 0; c < FTPLAYER_MAX_CHANNELS; ++c) {
+    FTPlayerChannel *ch = &self->channels[c];
+    const FTEventTrack *track = c < num_channels
+                                ? &events->tracks[ch->track] : 0;
+    if (!track) {
+      ch->track = 0;
+      ch->kind = FTPLAYER_N163;
+    }
+    ch->next_event = track ? track->events : 0;
+    ch->end_event = track ? track->events + track->num_events : 0;
+    ch->note = FTNOTE_CUT;
+    ch->instrument = FTINST_NONE;
+    ch->padding0 = 0;
+    ch->wave_id = FTPLAYER_NO_WAVE;
+  }
+  for (size_t v = 0; v < NUM_VOICES; ++v) {
+    mixer->voices[v].volume = 0;
+    mixer->voices[v].phase = 0;
+    mixer->voices[v].frequency = 0;
+  }
+
+  // Load the 2A03 waves before any N163 wave can take their space
+  const uint8_t *wave = builtin_waves;
+  for (size_t i = 0; i < FTPLAYER_NUM_BUILTIN_WAVES; ++i) {
+    self->builtin_starts[i] = plays_2a03
+      ? WtWaveCache_acquire(cache, mixer, FTPLAYER_BUILTIN_WAVE_ID + i,
+                            wave, builtin_lengths[i])
+      : WTCACHE_NO_WAVE;
+    wave += builtin_lengths[i];
+  }
+
+  FTEnvCursors_init(&self->envelopes);
+  FTEffects_init(&self->effects);
+  find_instrument_envelopes(self, programs);
+  WtPitchTable_init(&self->pitch_table, outrate);
+}
+
+// Ticks ////////////////////////////////////////////////////////////
+
+static void note_on(FTPlayer *self, size_t c, unsigned int note) {
+  FTPlayerChannel *ch = &self->channels[c];
+  FTEnvCursors *env = &self->envelopes;
+  size_t base = c * FTPLAYER_NUM_ENV_SLOTS;
+  FTEffects_note_on(&self->effects, c, note, ch->note != FTNOTE_CUT);
+  ch->note = note;
+  for (size_t slot = 0; slot < FTPLAYER_NUM_ENV_SLOTS; ++slot) {
+    FTEnvCursors_start(env, base + slot,
+                       ch->instrument < FTPLAYER_MAX_INSTRUMENTS
+                       ? self->instrument_envelopes[ch->instrument][slot]
+                       : 0);
+  }
+  env->base[base + FTPLAYER_ENV_VOLUME] = FTPLAYER_MAX_VOLUME;
+  env->base[base + FTPLAYER_ENV_ARPEGGIO] = note;
+  env->base[base + FTPLAYER_ENV_PITCH] = 0;
+}
+
+static void apply_event(FTPlayer *self, size_t c, const FTEvent *ev) {
+  FTPlayerChannel *ch = &self->channels[c];
+  if (ev->instrument < FTPLAYER_MAX_INSTRUMENTS) {
+    ch->instrument = ev->instrument;
+  }
+  if (ev->volume <= FTVOLCOL_MAX) {
+    FTEffects_set_volume(&self->effects, c, ev->volume);
+  }
+  FTEffects_apply(&self->effects, c, ev->effects);
+  self->envelopes.base[c * FTPLAYER_NUM_ENV_SLOTS + FTPLAYER_ENV_TIMBRE]
+    = self->effects.timbre[c];
+  if (ev->note < FTPLAYER_NUM_NOTES) {
+    note_on(self, c, ev->note);
+  } else if (ev->note == FTNOTE_RELEASE) {
+    size_t base = c * FTPLAYER_NUM_ENV_SLOTS;
+    for (size_t slot = 0; slot < FTPLAYER_NUM_ENV_SLOTS; ++slot) {
+      FTEnvCursors_release(&self->envelopes, base + slot);
+    }
+  } else if (ev->note == FTNOTE_CUT) {
+    ch->note = FTNOTE_CUT;
+  }
+}
+
+/**
+ * Points a voice at a wave in wave RAM.
+ */
+static void point_voice(WtVoice *voice, unsigned int start,
+                        unsigned int length) {
+  voice->start = start;
+  voice->length = length;
+  if (voice->phase >= (uint_fast32_t)length << 16) voice->phase = 0;
+}
+
+/**
+ * Pins a channel's N163 wave in wave RAM and points its voice at it.
+ * @return nonzero if the wave is in wave RAM
+ */
+static int set_wave(FTPlayer *self, size_t c, unsigned int wave_id) {
+  FTPlayerChannel *ch = &self->channels[c];
+  if ((int)wave_id == ch->wave_id) return 1;
+  if (ch->wave_id != FTPLAYER_NO_WAVE) {
+    WtWaveCache_release(self->cache, ch->wave_id);
+    ch->wave_id = FTPLAYER_NO_WAVE;
+  }
+  const FTWave *wave = FTWaveBank_get(self->module->waves, wave_id);
+  if (!wave) return 0;
+  int start = WtWaveCache_acquire(self->cache, self->mixer, wave_id,
+                                  wave->data, wave->length);
+  if (start == WTCACHE_NO_WAVE) return 0;
+  ch->wave_id = wave_id;
+  point_voice(&self->mixer->voices[c], start, wave->length);
+  return 1;
+}
+
+/**
+ * Points a 2A03 channel's voice at a precomputed wave.
+ * @return nonzero if the wave is in wave RAM
+ */
+static int set_builtin_wave(FTPlayer *self, size_t c, unsigned int i) {
+  int start = self->builtin_starts[i];
+  if (start == WTCACHE_NO_WAVE) return 0;
+  point_voice(&self->mixer->voices[c], start, builtin_lengths[i]);
+  return 1;
+}
+
+/**
+ * Sets a channel's voice from its note, instrument, and the outputs
+ * of its envelopes and effects.
+ */
+static void update_voice(FTPlayer *self, size_t c) {
+  const FTPlayerChannel *ch = &self->channels[c];
+  WtVoice *voice = &self->mixer->voices[c];
+  const int *env = &self->envelopes.out[c * FTPLAYER_NUM_ENV_SLOTS];
+  const FTPSGInstrument *inst = ch->instrument < FTPLAYER_MAX_INSTRUMENTS
+                                ? Gap_get(self->module->instruments,
+                                          ch->instrument)
+                                : 0;
+  if (ch->note == FTNOTE_CUT || !inst
+      || inst->chipid != kind_chipids[ch->kind]) {
+    voice->volume = 0;
+    return;
+  }
+
+  // The timbre envelope chooses the N163 wave or the pulse duty
+  int timbre = env[FTPLAYER_ENV_TIMBRE];
+  int has_wave = 0;
+  switch (ch->kind) {
+    case FTPLAYER_N163: {
+      size_t num_waves = Gap_size(inst->wave_ids);
+      if (!num_waves) break;
+      timbre = clamp(timbre, 0, num_waves - 1);
+      const unsigned short *wave_id = Gap_get(inst->wave_ids, timbre);
+      has_wave = set_wave(self, c, *wave_id);
+    } break;
+    case FTPLAYER_PULSE:
+      has_wave = set_builtin_wave(self, c,
+                                  FTPLAYER_WAVE_PULSE + (timbre & 0x03));
+      break;
+    case FTPLAYER_TRIANGLE:
+      has_wave = set_builtin_wave(self, c, FTPLAYER_WAVE_TRIANGLE);
+      break;
+  }
+  if (!has_wave) {
+    voice->volume = 0;
+    return;
+  }
+
+  // Pitch envelope values, like 2xx, lower the pitch, as FamiTracker
+  // adds them to the period
+  const FTEffects *fx = &self->effects;
+  int note = clamp(env[FTPLAYER_ENV_ARPEGGIO] + fx->out_note[c],
+                   0, FTPLAYER_NUM_NOTES - 1);
+  long pitch = (long)note * WTPITCH_SEMITONE + fx->out_pitch[c]
+               - (long)env[FTPLAYER_ENV_PITCH] * FTFX_PITCH_STEP;
+
+  // The 2A03 pulse's 8-step sequencer is clocked at half the rate of
+  // the triangle's 32-step sequencer, so for the same period value a
+  // triangle cycle takes twice as long and sounds an octave lower
+  if (ch->kind == FTPLAYER_TRIANGLE) pitch -= 12 * WTPITCH_SEMITONE;
+  voice->frequency = WtPitchTable_pitch(&self->pitch_table, pitch,
+                                        voice->length);
+
+  // Volume column scales the envelope, rounding toward 1 so that a
+  // quiet note stays audible
+  unsigned int env_volume = clamp(env[FTPLAYER_ENV_VOLUME], 0,
+                                  FTPLAYER_MAX_VOLUME);
+  unsigned int volcol = fx->out_volume[c];
+  unsigned int volume = env_volume * volcol / FTVOLCOL_MAX;
+  if (volume == 0 && env_volume && volcol) volume = 1;
+
+  // The triangle has no volume control, only on and off
+  if (ch->kind == FTPLAYER_TRIANGLE && env_volume) {
+    volume = FTPLAYER_MAX_VOLUME;
+  }
+  voice->volume = volume;
+}
+
+/**
+ * Moves each channel's next event to the first at or after a tick.
+ */
+static void seek_events(FTPlayer *self, unsigned int tick) {
+  for (size_t c = 0; c < self->num_channels; ++c) {
+    const FTEventTrack *track = &self->events->tracks[self->channels[c].track];
+    size_t lo = 0, hi = track->num_events;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (track->events[mid].tick < tick) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    self->channels[c].next_event = track->events + lo;
+  }
+}
+
+static void mute_all(FTPlayer *self) {
+  for (size_t c = 0; c < NUM_VOICES; ++c) {
+    self->mixer->voices[c].volume = 0;
+  }
+}
+
+static void play_tick(FTPlayer *self) {
+  unsigned int tick = self->tick;
+  for (size_t c = 0; c < self->num_channels; ++c) {
+    FTPlayerChannel *ch = &self->channels[c];
+    for (; ch->next_event < ch->end_event && ch->next_event->tick == tick;
+         ++ch->next_event) {
+      apply_event(self, c, ch->next_event);
+    }
+  }
+  FTEnvCursors_tick(&self->envelopes,
+                    self->num_channels * FTPLAYER_NUM_ENV_SLOTS);
+  FTEffects_tick(&self->effects, self->num_channels);
+  for (size_t c = 0; c < self->num_channels; ++c) {
+    update_voice(self, c);
+  }
+
+  // Find the next tick, following the song's loop
+  const FTMetronome *metronome = self->metronome;
+  self->ticks_played += 1;
+  self->tick = tick + 1;
+  if (self->tick >= metronome->length_ticks) {
+    if (metronome->loop_index == FTMETRONOME_NONE) {
+      self->ended = 1;
+    } else {
+      self->tick = metronome->rows[metronome->loop_index].tick;
+      seek_events(self, self->tick);
+    }
+  }
+  self->next_tick_sample += WtTickClock_next(&self->clock);
+}
+
+// Rendering ////////////////////////////////////////////////////////
+
+size_t FTPlayer_render(FTPlayer *self, int16_t *out, size_t num_samples) {
+  size_t done = 0;
+  while (done < num_samples) {
+    if (self->samples_played >= self->next_tick_sample) {
+      if (self->ended) {
+        mute_all(self);
+        break;
+      }
+      play_tick(self);
+      continue;
+    }
+
+    size_t n = num_samples - done;
+    if (n > self->next_tick_sample - self->samples_played) {
+      n = self->next_tick_sample - self->samples_played;
+    }
+    WtMixer_render(self->mixer, out + done, n);
+    done += n;
+    self->samples_played += n;
+  }
+  return done;
+}
+
+// Player states ////////////////////////////////////////////////////
+
+#define FNV_PRIME 0x100000001B3u
+
+uint_fast64_t FTPlayer_hash_bytes(uint_fast64_t hash, const void *data,
+                                  size_t length) {
+  const unsigned char *s = data;
+  for (size_t i = 0; i < length; ++i) {
+    hash = ((hash ^ s[i]) * FNV_PRIME) & 0xFFFFFFFFFFFFFFFFu;
+  }
+  return hash;
+}
+
+void FTPlayer_save_state(const FTPlayer *self, FTPlayerState *out) {
+  out->clock_accum = self->clock.accum;
+  out->padding0 = 0;
+  memcpy(out->channels, self->channels, sizeof(out->channels));
+  for (size_t c = 0; c < FTPLAYER_MAX_CHANNELS; ++c) {
+    out->channels[c].next_event = out->channels[c].end_event = 0;
+  }
+  memcpy(&out->envelopes, &self->envelopes, sizeof(out->envelopes));
+  memcpy(&out->effects, &self->effects, sizeof(out->effects));
+  memcpy(out->voices, self->mixer->voices, sizeof(out->voices));
+}
+
+static int voices_equal(const WtVoice *a, const WtVoice *b) {
+  for (size_t v = 0; v < NUM_VOICES; ++v) {
+    if (a[v].volume != b[v].volume || a[v].phase != b[v].phase) return 0;
+    // A muted voice's other fields are set again before it is heard
+    if (a[v].volume == 0) continue;
+    if (a[v].frequency != b[v].frequency
+        || a[v].start != b[v].start || a[v].length != b[v].length) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int FTPlayerState_equal(const FTPlayerState *a, const FTPlayerState *b) {
+  return a->clock_accum == b->clock_accum
+         && !memcmp(a->channels, b->channels, sizeof(a->channels))
+         && !memcmp(&a->envelopes, &b->envelopes, sizeof(a->envelopes))
+         && !memcmp(&a->effects, &b->effects, sizeof(a->effects))
+         && voices_equal(a->voices, b->voices);
+}
+
+uint_fast64_t FTPlayerState_hash(const FTPlayerState *self,
+                                 uint_fast64_t hash) {
+  hash = FTPlayer_hash_bytes(hash, &self->clock_accum,
+                             sizeof(self->clock_accum));
+  hash = FTPlayer_hash_bytes(hash, self->channels, sizeof(self->channels));
+  hash = FTPlayer_hash_bytes(hash, &self->envelopes,
+                             sizeof(self->envelopes));
+  hash = FTPlayer_hash_bytes(hash, &self->effects, sizeof(self->effects));
+  for (size_t v = 0; v < NUM_VOICES; ++v) {
+    const WtVoice *voice = &self->voices[v];
+    uint_least32_t fields[4] = {
+      voice->volume, voice->phase, 0, 0
+    };
+    if (voice->volume) {
+      fields[2] = voice->frequency;
+      fields[3] = voice->start << 8 | voice->length;
+    }
+    hash = FTPlayer_hash_bytes(hash, fields, sizeof(fields));
+  }
+  return hash;
+}
+
+/**
+ * Returns the player to a saved state, keeping its song position.
+ * Waves that the state's channels use are pinned again, possibly at
+ * other places in wave RAM than when the state was saved.
+ */
+static void restore_state(FTPlayer *self, const FTPlayerState *state) {
+  self->clock.accum = state->clock_accum;
+  for (size_t c = 0; c < FTPLAYER_MAX_CHANNELS; ++c) {
+    FTPlayerChannel *ch = &self->channels[c];
+    const FTPlayerChannel *saved = &state->channels[c];
+    WtVoice *voice = &self->mixer->voices[c];
+    ch->note = saved->note;
+    ch->instrument = saved->instrument;
+    *voice = state->voices[c];
+
+    // Pin the state's wave before unpinning the current one, so that
+    // a wave used by both stays where it is
+    int start = WTCACHE_NO_WAVE;
+    if (saved->wave_id != FTPLAYER_NO_WAVE) {
+      const FTWave *wave = FTWaveBank_get(self->module->waves,
+                                          saved->wave_id);
+      if (wave) {
+        start = WtWaveCache_acquire(self->cache, self->mixer,
+                                    saved->wave_id, wave->data,
+                                    wave->length);
+      }
+    }
+    if (ch->wave_id != FTPLAYER_NO_WAVE) {
+      WtWaveCache_release(self->cache, ch->wave_id);
+    }
+    ch->wave_id = FTPLAYER_NO_WAVE;
+    if (start != WTCACHE_NO_WAVE) {
+      ch->wave_id = saved->wave_id;
+      voice->start = start;
+    } else if (saved->wave_id != FTPLAYER_NO_WAVE) {
+      voice->volume = 0;
+    }
+  }
+  memcpy(&self->envelopes, &state->envelopes, sizeof(self->envelopes));
+  memcpy(&self->effects, &state->effects, sizeof(self->effects));
+}
+
+// Segment cache ////////////////////////////////////////////////////
+
+/**
+ * Finds the end of the segment that begins at a row: the first later
+ * row that enters another order row or goes back within this one.
+ * @param first index in metronome->rows
+ * @return an index in metronome->rows, or num_rows at the song's end
+ */
+static size_t segment_end(const FTMetronome *metronome, size_t first) {
+  const FTRowTiming *rows = metronome->rows;
+  size_t i = first + 1;
+  while (i < metronome->num_rows && rows[i].order_row == rows[first].order_row
+         && rows[i].row > rows[i - 1].row) {
+    ++i;
+  }
+  return i;
+}
+
+uint64_t FTPlayer_render_segments(FTPlayer *self, FTSegmentCache *cache,
+                                  int16_t *out, uint64_t num_samples) {
+  const FTMetronome *metronome = self->metronome;
+  uint64_t done = 0;
+  FTPlayerState entry_state;
+  FTSegmentKey key;
+  while (done < num_samples) {
+    if (self->ended) {
+      mute_all(self);
+      break;
+    }
+
+    // Measure the segment from here to the next order row
+    size_t first = FTMetronome_find_tick(metronome, self->tick);
+    uint64_t seg_samples = 0;
+    size_t last = first;
+    unsigned int end_tick = self->tick;
+    if (first != FTMETRONOME_NONE
+        && metronome->rows[first].tick == self->tick
+        && self->samples_played == self->next_tick_sample) {
+      last = segment_end(metronome, first);
+      end_tick = last < metronome->num_rows
+                 ? metronome->rows[last].tick
+                 : metronome->length_ticks;
+      WtTickClock clock = self->clock;
+      for (unsigned int t = self->tick; t < end_tick; ++t) {
+        seg_samples += WtTickClock_next(&clock);
+      }
+    }
+
+    // Mix what is left if no whole segment fits
+    if (seg_samples == 0 || seg_samples > num_samples - done) {
+      uint64_t n = num_samples - done;
+      if (n > SIZE_MAX) n = SIZE_MAX;
+      size_t rendered = FTPlayer_render(self, out + done, n);
+      done += rendered;
+      if (rendered < n) break;
+      continue;
+    }
+
+    FTPlayer_save_state(self, &entry_state);
+    const FTSegment *seg = FTSegmentCache_find(cache, &key, metronome, first,
+                                               last - first,
+                                               end_tick - self->tick,
+                                               &entry_state);
+
+    // A segment of another length cannot stand in for this one, nor
+    // can it be replaced under the same key
+    if (!seg || seg->num_samples != seg_samples) {
+      FTPlayer_render(self, out + done, seg_samples);
+      if (!seg) {
+        FTPlayer_save_state(self, &entry_state);
+        FTSegmentCache_add(cache, &key, &entry_state, out + done,
+                           seg_samples);
+      }
+      done += seg_samples;
+      continue;
+    }
+
+    // Continue after the segment as if it had been mixed
+    memcpy(out + done, seg->samples, seg_samples * sizeof(out[0]));
+    restore_state(self, &seg->exit_state);
+    self->ticks_played += end_tick - self->tick;
+    self->samples_played += seg_samples;
+    self->next_tick_sample = self->samples_played;
+    self->tick = end_tick;
+    if (end_tick >= metronome->length_ticks) {
+      if (metronome->loop_index == FTMETRONOME_NONE) {
+        self->ended = 1;
+      } else {
+        self->tick = metronome->rows[metronome->loop_index].tick;
+      }
+    }
+    seek_events(self, self->tick);
+    done += seg_samples;
+  }
+  return done;
+}
+
+// Looped export ////////////////////////////////////////////////////
+
+/**
+ * Returns the output sample at which a pass through the loop starts.
+ * @param pass 0 for the first pass
+ */
+static uint64_t loop_pass_sample(const FTPlayer *self, uint64_t pass) {
+  const FTMetronome *metronome = self->metronome;
+  uint64_t loop_tick = metronome->rows[metronome->loop_index].tick;
+  uint64_t loop_ticks = metronome->length_ticks - loop_tick;
+  return FTMetronome_tick_to_sample(metronome, loop_tick + pass * loop_ticks,
+                                    self->outrate);
+}
+
+uint64_t FTPlayer_loops_length(const FTPlayer *self, unsigned int num_loops,
+                               uint64_t fade_samples) {
+  const FTMetronome *metronome = self->metronome;
+  if (metronome->loop_index == FTMETRONOME_NONE) {
+    return FTMetronome_tick_to_sample(metronome, metronome->length_ticks,
+                                      self->outrate);
+  }
+  return loop_pass_sample(self, num_loops) + fade_samples;
+}
+
+/**
+ * Renders up to a sample, in pieces that fit a size_t.
+ */
+static void render_to(FTPlayer *self, int16_t *out, uint64_t end) {
+  while (self->samples_played < end) {
+    uint64_t n = end - self->samples_played;
+    if (n > SIZE_MAX) n = SIZE_MAX;
+    size_t start = self->samples_played;
+    if (FTPlayer_render(self, out + start, n) < n) break;
+  }
+}
+
+uint64_t FTPlayer_render_loops(FTPlayer *self, int16_t *out,
+                               unsigned int num_loops, uint64_t fade_samples,
+                               uint64_t *out_reused) {
+  uint64_t total = FTPlayer_loops_length(self, num_loops, fade_samples);
+  uint64_t reused = 0;
+  if (self->metronome->loop_index == FTMETRONOME_NONE) {
+    render_to(self, out, total);
+    total = self->samples_played;
+    fade_samples = 0;
+  } else {
+    // Mix the intro, then each pass until one starts in the same state
+    // as the pass before it
+    FTPlayerState states[2];
+    render_to(self, out, loop_pass_sample(self, 0));
+    FTPlayer_save_state(self, &states[0]);
+    uint64_t period = 0;
+    for (uint64_t pass = 1; self->samples_played < total; ++pass) {
+      uint64_t end = loop_pass_sample(self, pass);
+      render_to(self, out, end < total ? end : total);
+      if (self->samples_played < end) break;
+      FTPlayerState *prev = &states[(pass - 1) % 2];
+      FTPlayerState *now = &states[pass % 2];
+      FTPlayer_save_state(self, now);
+      if (FTPlayerState_equal(prev, now)) {
+        period = end - loop_pass_sample(self, pass - 1);
+        break;
+      }
+    }
+
+    // The rest repeats the last pass
+    if (period) {
+      for (uint64_t i = self->samples_played; i < total; ) {
+        uint64_t n = total - i < period ? total - i : period;
+        memcpy(out + i, out + i - period, n * sizeof(out[0]));
+        i += n;
+      }
+      reused = total - self->samples_played;
+    }
+  }
+
+  // Fade out to silence
+  int16_t *fade = out + total - fade_samples;
+  for (uint64_t t = 0; t < fade_samples; ++t) {
+    fade[t] = (int_fast64_t)fade[t] * (int_fast64_t)(fade_samples - t)
+              / (int_fast64_t)fade_samples;
+  }
+  FTPlayer_stop(self);
+  if (out_reused) *out_reused = reused;
+  return total;
+}
+
+void FTPlayer_dry_run(FTPlayer *self, FTPlayerStats *out) {
+  const FTMetronome *metronome = self->metronome;
+  out->length_ticks = metronome->length_ticks;
+  out->length_samples = FTMetronome_tick_to_sample(
+    metronome, metronome->length_ticks, self->outrate
+  );
+  out->loops = metronome->loop_index != FTMETRONOME_NONE;
+  out->loop_tick = out->loops
+                   ? metronome->rows[metronome->loop_index].tick
+                   : metronome->length_ticks;
+  out->loop_sample = FTMetronome_tick_to_sample(
+    metronome, out->loop_tick, self->outrate
+  );
+  out->peak_voices = 0;
+  out->num_channels = self->num_channels;
+
+  // The event list holds exactly one playthrough
+  for (size_t c = 0; c < self->num_channels; ++c) {
+    const FTPlayerChannel *ch = &self->channels[c];
+    FTPlayerChannelStats *stats = &out->channels[c];
+    stats->track = ch->track;
+    stats->notes = 0;
+    stats->ticks_heard = 0;
+    for (const FTEvent *ev = ch->next_event; ev < ch->end_event; ++ev) {
+      if (ev->note < FTPLAYER_NUM_NOTES) stats->notes += 1;
+    }
+  }
+
+  while (!self->ended && self->ticks_played < metronome->length_ticks) {
+    play_tick(self);
+    size_t voices_heard = 0;
+    for (size_t c = 0; c < self->num_channels; ++c) {
+      if (self->mixer->voices[c].volume) {
+        voices_heard += 1;
+        out->channels[c].ticks_heard += 1;
+      }
+    }
+    if (voices_heard > out->peak_voices) out->peak_voices = voices_heard;
+  }
+  FTPlayer_stop(self);
+}
+
+void FTPlayer_stop(FTPlayer *self) {
+  for (size_t c = 0; c < FTPLAYER_MAX_CHANNELS; ++c) {
+    FTPlayerChannel *ch = &self->channels[c];
+    if (ch->wave_id != FTPLAYER_NO_WAVE) {
+      WtWaveCache_release(self->cache, ch->wave_id);
+      ch->wave_id = FTPLAYER_NO_WAVE;
+    }
+  }
+  for (size_t i = 0; i < FTPLAYER_NUM_BUILTIN_WAVES; ++i) {
+    if (self->builtin_starts[i] != WTCACHE_NO_WAVE) {
+      WtWaveCache_release(self->cache, FTPLAYER_BUILTIN_WAVE_ID + i);
+      self->builtin_starts[i] = WTCACHE_NO_WAVE;
+    }
+  }
+  mute_all(self);
+}
@@ -0,0 +1,258 @@
+#ifndef FTPLAYER_H
+#define FTPLAYER_H
+#include "ftmodule.h"
+#include "ftevents.h"
+#include "ftmetronome.h"
+#include "ftenvelope.h"
+#include "fteffects.h"
+#include "mixer.h"
+#include "wavecache.h"
+#include "pitchtable.h"
+
+/*
+A player plays one song of a module through a WtMixer.  Everything
+it reads is prepared beforehand: the song's metronome and event list,
+the module's compiled envelopes, and its wave bank.  The player keeps
+all of its own state in the FTPlayer struct, which the caller
+provides, so that once FTPlayer_init() returns, rendering allocates
+no memory and takes no locks and can run in an audio callback.
+
+Each tick, the player applies the events at that tick, steps the
+envelopes and effects of every channel, and sets the voices of the
+mixer from the result.  Between ticks, it mixes in spans as long as the
+caller's buffer allows, so the caller's block size need not divide a
+tick.
+
+Channel i plays through mixer voice i.  The 2A03 pulse and triangle
+channels come first, then the N163 channels that are heard.  The
+2A03 channels play precomputed waves that the player loads into wave
+RAM once, when it starts: an 8-sample wave for each pulse duty and a
+32-step triangle.  A duty change moves the voice's start to another
+of the waves, so a 2A03 channel costs the mixer the same as an N163
+channel.  2A03 noise and DPCM are not played.
+*/
+
+#define FTPLAYER_MAX_INSTRUMENTS 128
+#define FTPLAYER_NUM_NOTES WTPITCH_NUM_NOTES
+#define FTPLAYER_MAX_CHANNELS NUM_VOICES
+
+// Wave cache IDs of the precomputed waves, above any wave bank ID
+#define FTPLAYER_BUILTIN_WAVE_ID 0x10000
+
+enum FTPlayerChannelKind {
+  FTPLAYER_N163     = 0,
+  FTPLAYER_PULSE    = 1,
+  FTPLAYER_TRIANGLE = 2,
+};
+
+enum FTPlayerBuiltinWave {
+  FTPLAYER_WAVE_PULSE    = 0,  // duty 0-3 are waves 0-3
+  FTPLAYER_WAVE_TRIANGLE = 4,
+  FTPLAYER_NUM_BUILTIN_WAVES = 5
+};
+
+// Each channel has one envelope cursor for each of these
+enum FTPlayerEnvSlot {
+  FTPLAYER_ENV_VOLUME   = 0,
+  FTPLAYER_ENV_ARPEGGIO = 1,
+  FTPLAYER_ENV_PITCH    = 2,
+  FTPLAYER_ENV_TIMBRE   = 3,
+  FTPLAYER_NUM_ENV_SLOTS = 4
+};
+
+typedef struct FTPlayerChannel {
+  const FTEvent *next_event;  // first event not yet applied
+  const FTEvent *end_event;
+  size_t track;  // index in the event list
+  unsigned char kind;  // one of FTPLAYER_N163, etc.
+  unsigned char note;  // 0-95, or FTNOTE_CUT if silent
+  unsigned char instrument;  // 0-127, or FTINST_NONE
+  unsigned char padding0;
+  int wave_id;  // bank ID of the N163 wave pinned in wave RAM, or -1
+} FTPlayerChannel;
+
+/*
+A player state holds everything that decides a player's output from
+a tick boundary on, apart from where it is in the song: the tick
+clock's remainder, the channels, envelopes, and effects, and the
+mixer's voices.  Two states that are equal at the same song position
+produce the same samples from then on.  Event pointers, the song
+tick, and counts of ticks and samples played are left out, so that
+states taken at different places in a song can be compared.
+*/
+typedef struct FTPlayerState {
+  unsigned int clock_accum;
+  unsigned int padding0;
+  FTPlayerChannel channels[FTPLAYER_MAX_CHANNELS];
+  FTEnvCursors envelopes;
+  FTEffects effects;
+  WtVoice voices[NUM_VOICES];
+} FTPlayerState;
+
+struct FTSegmentCache;
+
+typedef struct FTPlayerChannelStats {
+  size_t track;  // index in the event list
+  unsigned long notes;  // notes started
+  unsigned long ticks_heard;  // ticks during which the voice is not muted
+} FTPlayerChannelStats;
+
+typedef struct FTPlayerStats {
+  unsigned int length_ticks;  // one playthrough, to the end or loop
+  uint64_t length_samples;
+  unsigned int loop_tick;  // where the loop starts, or length_ticks
+  uint64_t loop_sample;  // or length_samples
+  int loops;  // nonzero if the song loops instead of ending
+  size_t peak_voices;  // most voices heard at once
+  size_t num_channels;
+  FTPlayerChannelStats channels[FTPLAYER_MAX_CHANNELS];
+} FTPlayerStats;
+
+typedef struct FTPlayer {
+  FTModule *module;
+  const FTMetronome *metronome;
+  const FTEventList *events;
+  WtMixer *mixer;
+  WtWaveCache *cache;
+  unsigned int outrate;
+
+  unsigned int tick;  // the next tick to play, in the song
+  uint64_t ticks_played;  // ticks since the start, counting loops
+  uint64_t samples_played;
+  uint64_t next_tick_sample;  // when the next tick is played
+  WtTickClock clock;  // samples in each tick
+  int ended;  // nonzero once a song without a loop has no ticks left
+
+  size_t num_channels;
+  FTPlayerChannel channels[FTPLAYER_MAX_CHANNELS];
+  FTEnvCursors envelopes;  // [channel * FTPLAYER_NUM_ENV_SLOTS + slot]
+  FTEffects effects;  // [channel]
+
+  // each instrument's envelopes, or NULL for none
+  const FTEnvProgram *instrument_envelopes[FTPLAYER_MAX_INSTRUMENTS][FTPLAYER_NUM_ENV_SLOTS];
+  WtPitchTable pitch_table;
+  // start of each precomputed wave in wave RAM, or WTCACHE_NO_WAVE
+  int builtin_starts[FTPLAYER_NUM_BUILTIN_WAVES];
+} FTPlayer;
+
+/**
+ * Prepares to play a song from the start.  Silences every voice of
+ * the mixer, and loads the precomputed waves if the song plays 2A03
+ * pulse or triangle.
+ * @param module the module containing the song
+ * @param metronome the song's rows, from FTMetronome_new()
+ * @param events the song's events, from FTEventList_compile()
+ * @param programs the module's envelopes, from
+ * FTModule_compile_envelopes()
+ * @param mixer the mixer to play through
+ * @param cache the cache managing the mixer's wave RAM
+ * @param outrate the output sample rate in Hz
+ */
+void FTPlayer_init(FTPlayer *self, FTModule *module,
+                   const FTMetronome *metronome, const FTEventList *events,
+                   const FTEnvProgram *programs, WtMixer *mixer,
+                   WtWaveCache *cache, unsigned int outrate);
+
+/**
+ * Renders samples, playing each tick at the sample where it begins.
+ * A song that loops plays forever.
+ * @param out where to write signed samples
+ * @param num_samples the most samples to write
+ * @return the number of samples written, which is less than
+ * num_samples only if the song has ended
+ */
+size_t FTPlayer_render(FTPlayer *self, int16_t *out, size_t num_samples);
+
+/**
+ * Runs one playthrough of the song with everything but the mixing,
+ * to find its length, where it loops, and how busy each channel is.
+ * The voices' settings change, but no samples are mixed.  Afterward,
+ * the player's waves are unpinned, and FTPlayer_init() must be called
+ * again before rendering.
+ * @param out where to write the results
+ */
+void FTPlayer_dry_run(FTPlayer *self, FTPlayerStats *out);
+
+/**
+ * Returns the number of samples that FTPlayer_render_loops() writes.
+ * A song that ends instead of looping is rendered once, without a
+ * fade.
+ * @param num_loops times to play the looped part, at least 1
+ * @param fade_samples length of the fade-out after the last loop
+ */
+uint64_t FTPlayer_loops_length(const FTPlayer *self, unsigned int num_loops,
+                               uint64_t fade_samples);
+
+/**
+ * Renders a song for export: the intro once, the looped part
+ * num_loops times, then fade_samples more fading linearly to silence.
+ * At the start of each pass through the loop, the player compares its
+ * complete state (song position, channels, envelopes, effects, and
+ * voices, including their phases) with that at the start of the
+ * previous pass.  Once they match, the rest of the output would
+ * repeat the previous pass exactly, so it is copied instead of mixed.
+ * Call right after FTPlayer_init().  Afterward, the player's waves
+ * are unpinned, and FTPlayer_init() must be called again to play.
+ * @param out where to write FTPlayer_loops_length() samples
+ * @param out_reused if not NULL, receives the number of samples
+ * copied instead of mixed
+ * @return the number of samples written
+ */
+uint64_t FTPlayer_render_loops(FTPlayer *self, int16_t *out,
+                               unsigned int num_loops, uint64_t fade_samples,
+                               uint64_t *out_reused);
+
+/**
+ * Renders from the start of a song up to a sample count, reusing
+ * samples from a segment cache.  The song is cut into segments where
+ * it enters an order row.  A segment whose order row plays the same
+ * patterns, through the same rows at the same ticks, from the same
+ * player state as one in the cache is copied from the cache, and the
+ * player continues from the state at its end.  Other segments are
+ * mixed and added to the cache.  Call right after FTPlayer_init().
+ * Unlike FTPlayer_render(), this allocates memory.
+ * @param cache a cache from FTSegmentCache_new() for this song
+ * @param out where to write num_samples samples
+ * @return the number of samples written, which is less than
+ * num_samples only if the song has ended
+ */
+uint64_t FTPlayer_render_segments(FTPlayer *self,
+                                  struct FTSegmentCache *cache,
+                                  int16_t *out, uint64_t num_samples);
+
+/**
+ * Captures a player's state at a tick boundary.
+ */
+void FTPlayer_save_state(const FTPlayer *self, FTPlayerState *out);
+
+/**
+ * Tests whether two player states produce the same samples.
+ * Fields of muted voices that a tick sets before they are heard
+ * again are ignored.
+ */
+int FTPlayerState_equal(const FTPlayerState *a, const FTPlayerState *b);
+
+// The hash of no bytes, with which to start a hash
+#define FTPLAYER_HASH_SEED 0xCBF29CE484222325u
+
+/**
+ * Continues a 64-bit FNV-1a hash over some bytes.
+ * @param hash FTPLAYER_HASH_SEED or the hash of the bytes before these
+ */
+uint_fast64_t FTPlayer_hash_bytes(uint_fast64_t hash, const void *data,
+                                  size_t length);
+
+/**
+ * Hashes the fields of a player state that FTPlayerState_equal()
+ * compares.
+ */
+uint_fast64_t FTPlayerState_hash(const FTPlayerState *self,
+                                 uint_fast64_t hash);
+
+/**
+ * Unpins the player's waves, including the precomputed waves, from
+ * the wave cache.
+ */
+void FTPlayer_stop(FTPlayer *self);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+remembering rendered order rows
+*/
+#include "ftsegcache.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct FTSegmentCache {
+  FTSong *song;
+  HashMap *segments;  // HashMap<FTSegmentKey *, FTSegment *>
+  FTSegment *newest, *oldest;
+  size_t max_bytes;
+  FTSegmentCacheStats stats;
+};
+
+static int FTSegmentKey_cmp(const void *a, const void *b) {
+  const FTSegmentKey *ka = a, *kb = b;
+  if (ka->hash != kb->hash || ka->num_rows != kb->num_rows
+      || ka->num_ticks != kb->num_ticks
+      || ka->num_tracks != kb->num_tracks || ka->metronome != kb->metronome
+      || memcmp(ka->patterns, kb->patterns, ka->num_tracks)) {
+    return 1;
+  }
+
+  // The rows must be the same and begin at the same ticks from the
+  // start of the segment
+  const FTRowTiming *ra = &ka->metronome->rows[ka->first_row];
+  const FTRowTiming *rb = &kb->metronome->rows[kb->first_row];
+  for (size_t i = 0; i < ka->num_rows; ++i) {
+    if (ra[i].row != rb[i].row
+        || ra[i].tick - ra[0].tick != rb[i].tick - rb[0].tick) {
+      return 1;
+    }
+  }
+  return !FTPlayerState_equal(&ka->state, &kb->state);
+}
+
+static HashMapHashValue FTSegmentKey_hash(const void *a) {
+  const FTSegmentKey *key = a;
+  return (key->hash ^ key->hash >> 32) & 0xFFFFFFFFu;
+}
+
+static size_t segment_bytes(size_t num_samples) {
+  return sizeof(FTSegment) + num_samples * sizeof(int16_t);
+}
+
+FTSegmentCache *FTSegmentCache_new(FTSong *song, size_t max_bytes) {
+  FTSegmentCache *self = malloc(sizeof(FTSegmentCache));
+  if (!self) return 0;
+  self->song = song;
+  self->segments = HashMap_new(FTSegmentKey_cmp, FTSegmentKey_hash);
+  if (!self->segments) {
+    free(self);
+    return 0;
+  }
+  self->newest = self->oldest = 0;
+  self->max_bytes = max_bytes;
+  memset(&self->stats, 0, sizeof(self->stats));
+  return self;
+}
+
+void FTSegmentCache_delete(FTSegmentCache *self) {
+  if (!self) return;
+  for (FTSegment *seg = self->newest, *older; seg; seg = older) {
+    older = seg->older;
+    free(seg);
+  }
+  HashMap_delete(self->segments);
+  free(self);
+}
+
+static void unlink_segment(FTSegmentCache *self, FTSegment *seg) {
+  if (seg->newer) seg->newer->older = seg->older;
+  else self->newest = seg->older;
+  if (seg->older) seg->older->newer = seg->newer;
+  else self->oldest = seg->newer;
+}
+
+static void push_newest(FTSegmentCache *self, FTSegment *seg) {
+  seg->newer = 0;
+  seg->older = self->newest;
+  if (self->newest) self->newest->newer = seg;
+  else self->oldest = seg;
+  self->newest = seg;
+}
+
+const FTSegment *FTSegmentCache_find(FTSegmentCache *self, FTSegmentKey *key,
+                                     const FTMetronome *metronome,
+                                     size_t first_row, size_t num_rows,
+                                     unsigned int num_ticks,
+                                     const FTPlayerState *state) {
+  const FTRowTiming *rows = &metronome->rows[first_row];
+  key->metronome = metronome;
+  key->first_row = first_row;
+  key->num_rows = num_rows;
+  key->num_ticks = num_ticks;
+  key->patterns = Gap_get(self->song->order, rows[0].order_row);
+  key->num_tracks = Gap_elSize(self->song->order);
+  key->state = *state;
+
+  // Hash the patterns, the length, the rows, and the state
+  uint_fast64_t h = FTPlayer_hash_bytes(FTPLAYER_HASH_SEED, key->patterns,
+                                        key->num_tracks);
+  h = FTPlayer_hash_bytes(h, &num_ticks, sizeof(num_ticks));
+  for (size_t i = 0; i < num_rows; ++i) {
+    unsigned int fields[2] = {rows[i].row, rows[i].tick - rows[0].tick};
+    h = FTPlayer_hash_bytes(h, fields, sizeof(fields));
+  }
+  key->hash = FTPlayerState_hash(state, h);
+
+  self->stats.lookups += 1;
+  FTSegment *seg = HashMap_get(self->segments, key);
+  if (!seg) return 0;
+  self->stats.hits += 1;
+  unlink_segment(self, seg);
+  push_newest(self, seg);
+  return seg;
+}
+
+int FTSegmentCache_add(FTSegmentCache *self, const FTSegmentKey *key,
+                       const FTPlayerState *exit_state,
+                       const int16_t *samples, size_t num_samples) {
+  if (num_samples > (SIZE_MAX - sizeof(FTSegment)) / sizeof(int16_t)) {
+    return 0;
+  }
+  size_t bytes = segment_bytes(num_samples);
+  if (bytes > self->max_bytes) return 0;
+  while (self->oldest && self->stats.bytes + bytes > self->max_bytes) {
+    FTSegment *victim = self->oldest;
+    unlink_segment(self, victim);
+    HashMap_remove(self->segments, &victim->key);
+    self->stats.bytes -= segment_bytes(victim->num_samples);
+    self->stats.num_segments -= 1;
+    self->stats.evictions += 1;
+    free(victim);
+  }
+
+  FTSegment *seg = malloc(bytes);
+  if (!seg) return 0;
+  if (!HashMap_reserve(self->segments,
+                       HashMap_size(self->segments) + 1)) {
+    free(seg);
+    return 0;
+  }
+  seg->key = *key;
+  seg->exit_state = *exit_state;
+  seg->num_samples = num_samples;
+  memcpy(seg->samples, samples, num_samples * sizeof(int16_t));
+  HashMap_put(self->segments, &seg->key, seg);
+  push_newest(self, seg);
+  self->stats.bytes += bytes;
+  self->stats.num_segments += 1;
+  return 1;
+}
+
+void FTSegmentCache_stats(const FTSegmentCache *self,
+                          FTSegmentCacheStats *out) {
+  *out = self->stats;
+}
@@ -0,0 +1,93 @@
+#ifndef FTSEGCACHE_H
+#define FTSEGCACHE_H
+#include "ftplayer.h"
+
+/*
+A segment cache remembers the samples that a player rendered for
+each order row it entered, keyed on what decides them: the patterns
+that the order row plays, the rows played and the tick at which each
+begins, the segment's length in ticks, and the player's state on
+entry.  It also keeps the player's
+state on exit, so that after a hit, the player can continue as if it
+had mixed the segment itself.  Songs that repeat an order row, or
+play the same patterns in several order rows, with the same state
+then mix each repeat only once.
+
+The cache holds at most a given number of bytes of segments.  Adding
+a segment past that evicts the least recently used segments.
+*/
+
+typedef struct FTSegmentKey {
+  const FTMetronome *metronome;
+  size_t first_row;  // index in metronome->rows
+  size_t num_rows;
+  unsigned int num_ticks;  // including the last row's
+  const unsigned char *patterns;  // pattern ID of each track
+  size_t num_tracks;
+  uint_fast64_t hash;
+  FTPlayerState state;  // on entry
+} FTSegmentKey;
+
+typedef struct FTSegment {
+  FTSegmentKey key;
+  FTPlayerState exit_state;
+  struct FTSegment *newer, *older;
+  size_t num_samples;
+  int16_t samples[];
+} FTSegment;
+
+typedef struct FTSegmentCache FTSegmentCache;
+
+typedef struct FTSegmentCacheStats {
+  unsigned long lookups, hits, evictions;
+  size_t num_segments;
+  size_t bytes;  // of segments, including their keys and states
+} FTSegmentCacheStats;
+
+/**
+ * Creates an empty segment cache for one song.
+ * @param max_bytes the most memory that segments may use
+ * @return the cache, or NULL if out of memory
+ */
+FTSegmentCache *FTSegmentCache_new(FTSong *song, size_t max_bytes);
+
+/**
+ * Frees a segment cache and its segments.
+ */
+void FTSegmentCache_delete(FTSegmentCache *self);
+
+/**
+ * Fills in the key of a segment and looks it up.
+ * @param key where to write the key, which FTSegmentCache_add() takes
+ * if the lookup misses
+ * @param first_row index in metronome->rows of the segment's first row
+ * @param num_rows rows in the segment
+ * @param num_ticks ticks in the segment, including the last row's
+ * @param state the player's state at the start of the segment
+ * @return the segment, or NULL if absent
+ */
+const FTSegment *FTSegmentCache_find(FTSegmentCache *self, FTSegmentKey *key,
+                                     const FTMetronome *metronome,
+                                     size_t first_row, size_t num_rows,
+                                     unsigned int num_ticks,
+                                     const FTPlayerState *state);
+
+/**
+ * Adds a segment, evicting others until it fits.  Does nothing if
+ * the segment alone is larger than the cache.
+ * @param key a key from a FTSegmentCache_find() that missed
+ * @param exit_state the player's state after the segment
+ * @param samples the segment's samples
+ * @return nonzero if added, or 0 if too large or out of memory
+ */
+int FTSegmentCache_add(FTSegmentCache *self, const FTSegmentKey *key,
+                       const FTPlayerState *exit_state,
+                       const int16_t *samples, size_t num_samples);
+
+/**
+ * Reports how often lookups hit and how much memory segments use.
+ */
+void FTSegmentCache_stats(const FTSegmentCache *self,
+                          FTSegmentCacheStats *out);
+
+#endif
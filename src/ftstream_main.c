@@ -0,0 +1,305 @@
+/* to build:
+gcc -Wall -Wextra -O2 -pthread -o ftstream ftstream_main.c ftplayer.c ftsegcache.c fteffects.c ftparse.c ftmodule.c ftevents.c ftmetronome.c ftenvelope.c ftwavebank.c gaplist.c hashmap.c allocator.c mixer.c wavecache.c pitchtable.c pcmring.c ../build/ftkeywords.c -lm
+
+to listen:
+./ftstream song.txt | pacat --raw --format=s16le --rate=48000 --channels=1
+*/
+
+/*
+Streams a song in real time as raw signed 16-bit mono PCM, as a
+preview would, and measures whether rendering keeps up.
+
+A render thread mixes one block at a time into a PcmRing, staying
+at most STREAM_LEAD_BLOCKS ahead.  The main thread wakes at the
+wall-clock time at which each block is due, takes it from the ring,
+and writes it to standard output or a file or FIFO.  A block that is
+not ready by then is a deadline miss and is written as silence.
+
+The render thread times each block and sorts its render time, as a
+fraction of the block's length in real time, into a histogram.  A
+song whose blocks all render in a small fraction of their length
+has room for more voices or a higher rate.  A block that renders
+slower than real time is not late if the lead absorbs it; blocks
+that are late are the ring's underruns, reported separately.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ftplayer.h"
+#include "pcmring.h"
+
+FTModule *FTModule_fromtxt(FILE *restrict infp, const char *restrict filename);
+
+#define STREAM_MIN_BLOCK 64
+#define STREAM_MAX_BLOCK 512
+#define STREAM_LEAD_BLOCKS 4
+
+// Upper bounds of the histogram's buckets, in percent of a block's
+// length; the last bucket holds blocks that rendered slower than
+// real time
+static const unsigned char bucket_limits[] = {1, 2, 5, 10, 20, 50, 100};
+#define NUM_BUCKETS (sizeof bucket_limits + 1)
+
+typedef struct Streamer {
+  FTPlayer player;
+  WtMixer mixer;
+  WtWaveCache cache;
+  PcmRing *ring;
+  size_t block_samples;
+  uint64_t length_samples;  // one playthrough
+  double block_seconds;
+
+  // Written by the render thread, read after it ends
+  unsigned long blocks;
+  unsigned long histogram[NUM_BUCKETS];
+  double worst_seconds;
+  size_t peak_voices;
+} Streamer;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t) {
+  struct timespec ts;
+  ts.tv_sec = t;
+  ts.tv_nsec = (t - ts.tv_sec) * 1e9;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {
+  }
+}
+
+// Render thread ////////////////////////////////////////////////////
+
+/**
+ * Records how long a block took to render.
+ */
+static void record_block(Streamer *self, double seconds) {
+  unsigned int percent_x10 = seconds / self->block_seconds * 1000;
+  size_t b = 0;
+  while (b < sizeof bucket_limits && percent_x10 >= bucket_limits[b] * 10u) {
+    ++b;
+  }
+  self->histogram[b] += 1;
+  self->blocks += 1;
+  if (seconds > self->worst_seconds) self->worst_seconds = seconds;
+}
+
+static void *render_thread(void *arg) {
+  Streamer *self = arg;
+  int16_t block[STREAM_MAX_BLOCK];
+  size_t lead = self->block_samples * STREAM_LEAD_BLOCKS;
+  uint64_t samples_left = self->length_samples;
+  while (samples_left > 0) {
+    // Stay no more than the lead ahead of the output
+    while (PcmRing_fill(self->ring) + self->block_samples > lead) {
+      sleep_until(now() + self->block_seconds / 2);
+    }
+
+    size_t n = samples_left < self->block_samples
+               ? samples_left : self->block_samples;
+    double start = now();
+    n = FTPlayer_render(&self->player, block, n);
+    if (n == 0) break;
+    record_block(self, now() - start);
+    size_t voices_heard = 0;
+    for (size_t c = 0; c < NUM_VOICES; ++c) {
+      if (self->mixer.voices[c].volume) voices_heard += 1;
+    }
+    if (voices_heard > self->peak_voices) self->peak_voices = voices_heard;
+    PcmRing_write(self->ring, block, n);
+    samples_left -= n;
+  }
+  FTPlayer_stop(&self->player);
+  PcmRing_close(self->ring);
+  return 0;
+}
+
+// Output ///////////////////////////////////////////////////////////
+
+/**
+ * Writes all of a buffer to a file descriptor.
+ * @return 0 if successful or -1 on error
+ */
+static int write_all(int fd, const int16_t *samples, size_t n) {
+  const char *p = (const char *)samples;
+  size_t bytes = n * sizeof(int16_t);
+  while (bytes > 0) {
+    ssize_t written = write(fd, p, bytes);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += written;
+    bytes -= written;
+  }
+  return 0;
+}
+
+/**
+ * Takes each block from the ring when it is due and writes it out.
+ * The ring counts blocks that are late as underruns.
+ * @return 0 if successful or -1 on write error
+ */
+static int output_blocks(Streamer *self, int fd) {
+  int16_t block[STREAM_MAX_BLOCK];
+
+  // Let the render thread get its lead before the clock starts
+  while (!PcmRing_finished(self->ring)
+         && PcmRing_fill(self->ring) < self->block_samples
+                                       * (STREAM_LEAD_BLOCKS - 1)) {
+    sleep_until(now() + self->block_seconds / 4);
+  }
+
+  double start = now();
+  for (uint64_t k = 0; !PcmRing_finished(self->ring); ++k) {
+    sleep_until(start + k * self->block_seconds);
+    size_t n = PcmRing_read(self->ring, block, self->block_samples);
+    if (n < self->block_samples && !PcmRing_finished(self->ring)) {
+      memset(block + n, 0, (self->block_samples - n) * sizeof(int16_t));
+      n = self->block_samples;
+    }
+    if (write_all(fd, block, n) < 0) return -1;
+  }
+  return 0;
+}
+
+static void print_report(const Streamer *self, unsigned int outrate) {
+  PcmRingStats ring;
+  PcmRing_stats(self->ring, &ring);
+  fprintf(stderr, "%lu blocks of %zu samples at %u Hz (%.2f ms); "
+          "up to %zu voices\n",
+          self->blocks, self->block_samples, outrate,
+          self->block_seconds * 1e3, self->peak_voices);
+  fprintf(stderr, "render time as share of block length:\n");
+  for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+    if (b < sizeof bucket_limits) {
+      fprintf(stderr, "  under %3u%%: %lu\n", bucket_limits[b],
+              self->histogram[b]);
+    } else {
+      fprintf(stderr, "  render slower than real time: %lu\n",
+              self->histogram[b]);
+    }
+  }
+  fprintf(stderr, "worst block %.1f us (%.1f%%); %lu blocks late, "
+          "%zu samples of silence inserted; peak lead %zu samples\n",
+          self->worst_seconds * 1e6,
+          self->worst_seconds / self->block_seconds * 100,
+          ring.underruns, ring.underrun_samples, ring.peak_lead);
+}
+
+// Driver program ///////////////////////////////////////////////////
+
+int stream_song(FTModule *module, FTSong *song, const FTEnvProgram *programs,
+                int fd, size_t block_samples, unsigned int outrate) {
+  FTMetronome *metronome = FTMetronome_new(module, song);
+  FTEventList *events = metronome ? FTEventList_compile(song, metronome) : 0;
+  Streamer *self = calloc(1, sizeof(Streamer));
+  PcmRing *ring = PcmRing_new(block_samples * (STREAM_LEAD_BLOCKS + 1));
+  int result = -1;
+  if (!events || !self || !ring) {
+    fputs("out of memory\n", stderr);
+    goto cleanup;
+  }
+
+  self->ring = ring;
+  self->block_samples = block_samples;
+  self->block_seconds = (double)block_samples / outrate;
+  self->length_samples = FTMetronome_tick_to_sample(
+    metronome, metronome->length_ticks, outrate
+  );
+  WtWaveCache_init(&self->cache);
+  FTPlayer_init(&self->player, module, metronome, events, programs,
+                &self->mixer, &self->cache, outrate);
+
+  pthread_t renderer;
+  if (pthread_create(&renderer, 0, render_thread, self)) {
+    fputs("could not start render thread\n", stderr);
+    FTPlayer_stop(&self->player);
+    goto cleanup;
+  }
+  int write_failed = output_blocks(self, fd) < 0;
+  if (write_failed) {
+    perror("write");
+
+    // Drain the ring so that the render thread can finish
+    int16_t discard[STREAM_MAX_BLOCK];
+    while (!PcmRing_finished(ring)) {
+      if (!PcmRing_read(ring, discard, block_samples)) {
+        sleep_until(now() + self->block_seconds);
+      }
+    }
+  }
+  pthread_join(renderer, 0);
+  if (!write_failed) {
+    print_report(self, outrate);
+    result = 0;
+  }
+
+cleanup:
+  PcmRing_delete(ring);
+  free(self);
+  FTEventList_delete(events);
+  FTMetronome_delete(metronome);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "parsertest.txt";
+  const char *outfilename = argc > 2 ? argv[2] : "-";
+  size_t block_samples = argc > 3 ? strtoul(argv[3], 0, 10) : 256;
+  unsigned int outrate = argc > 4 ? strtoul(argv[4], 0, 10) : 48000;
+  if (block_samples < STREAM_MIN_BLOCK || block_samples > STREAM_MAX_BLOCK) {
+    fprintf(stderr, "block size must be %d to %d samples\n",
+            STREAM_MIN_BLOCK, STREAM_MAX_BLOCK);
+    return EXIT_FAILURE;
+  }
+  if (outrate < 8000 || outrate > 192000) {
+    fputs("rate must be 8000 to 192000 Hz\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  FILE *infp = fopen(filename, "r");
+  if (!infp) {
+    perror(filename);
+    return EXIT_FAILURE;
+  }
+  FTModule *module = FTModule_fromtxt(infp, filename);
+  fclose(infp);
+  if (!module) {
+    fprintf(stderr, "%s: error loading\n", filename);
+    return EXIT_FAILURE;
+  }
+
+  // A FIFO opens once a reader such as pacat or aplay opens it.  If
+  // the reader quits, stop with a write error instead of SIGPIPE.
+  signal(SIGPIPE, SIG_IGN);
+  int fd = strcmp(outfilename, "-")
+           ? open(outfilename, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+           : STDOUT_FILENO;
+  FTSong *song = Gap_get(module->songs, 0);
+  FTEnvProgram *programs = FTModule_compile_envelopes(module);
+  int result = EXIT_FAILURE;
+  if (fd < 0) {
+    perror(outfilename);
+  } else if (!song) {
+    fprintf(stderr, "%s: no songs\n", filename);
+  } else if (!programs && Gap_size(module->all_envelopes)) {
+    fputs("out of memory compiling envelopes\n", stderr);
+  } else if (stream_song(module, song, programs, fd, block_samples,
+                         outrate) == 0) {
+    result = 0;
+  }
+  if (fd >= 0 && fd != STDOUT_FILENO) close(fd);
+  free(programs);
+  FTModule_delete(module);
+  return result;
+}
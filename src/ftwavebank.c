@@ -0,0 +1,91 @@
+/*
+deduplicating N163 waves by content
+*/
+#include "ftwavebank.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPECTED_WAVES 32
+
+static int FTWave_cmp(const void *a, const void *b) {
+  const FTWave *wa = a, *wb = b;
+  if (wa->length != wb->length) return 1;
+  return memcmp(wa->data, wb->data, wa->length);
+}
+
+static HashMapHashValue FTWave_hash(const void *a) {
+  // 32-bit FNV-1a over the length and samples
+  const FTWave *wa = a;
+  uint_least32_t h = 2166136261u;
+  h = (h ^ wa->length) * 16777619u;
+  for (size_t i = 0; i < wa->length; ++i) {
+    h = (h ^ wa->data[i]) * 16777619u;
+  }
+  return h & 0xFFFFFFFFu;
+}
+
+static void free_each_wave(void *els, size_t n, void *ctx) {
+  (void)ctx;
+  FTWave **waves = els;
+  for (size_t i = 0; i < n; ++i) free(waves[i]);
+}
+
+FTWaveBank *FTWaveBank_new(void) {
+  FTWaveBank *self = malloc(sizeof(FTWaveBank));
+  if (!self) return 0;
+  self->waves = Gap_new(sizeof(FTWave *), EXPECTED_WAVES);
+  self->by_content = HashMap_new(FTWave_cmp, FTWave_hash);
+  if (!self->waves || !self->by_content) {
+    FTWaveBank_delete(self);
+    return 0;
+  }
+  return self;
+}
+
+void FTWaveBank_delete(FTWaveBank *self) {
+  if (!self) return;
+  Gap_forEachSpan(self->waves, free_each_wave, 0);
+  Gap_delete(self->waves);
+  HashMap_delete(self->by_content);
+  free(self);
+}
+
+int FTWaveBank_reserve(FTWaveBank *self, size_t n) {
+  size_t size = Gap_size(self->waves);
+  if (n > FTWAVE_MAX_ID + 1 - size) n = FTWAVE_MAX_ID + 1 - size;
+  return HashMap_reserve(self->by_content, size + n);
+}
+
+unsigned int FTWaveBank_intern(FTWaveBank *self, const unsigned char *data,
+                               size_t length) {
+  if (length < 1 || length > 255) return FTWAVE_NONE;
+
+  // Look the wave up through a key on the stack, so that a wave
+  // already in the bank costs no allocation
+  _Alignas(FTWave) unsigned char key_buf[sizeof(FTWave) + 255];
+  FTWave *key = (FTWave *)key_buf;
+  key->id = 0;
+  key->length = length;
+  key->padding0 = 0;
+  memcpy(key->data, data, length);
+  const FTWave *existing = HashMap_get(self->by_content, key);
+  if (existing) return existing->id;
+
+  // Reserve first, as HashMap_put() cannot report running out of memory
+  size_t id = Gap_size(self->waves);
+  if (id > FTWAVE_MAX_ID
+      || !HashMap_reserve(self->by_content,
+                          HashMap_size(self->by_content) + 1)) {
+    return FTWAVE_NONE;
+  }
+  FTWave *wave = malloc(sizeof(FTWave) + length);
+  if (!wave) return FTWAVE_NONE;
+  memcpy(wave, key, sizeof(FTWave) + length);
+  wave->id = id;
+  if (!Gap_add(self->waves, &wave)) {
+    free(wave);
+    return FTWAVE_NONE;
+  }
+  HashMap_put(self->by_content, wave, wave);
+  return id;
+}
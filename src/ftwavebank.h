@@ -0,0 +1,70 @@
+#ifndef FTWAVEBANK_H
+#define FTWAVEBANK_H
+#include "gaplist.h"
+#include "hashmap.h"
+
+/*
+A wave bank holds each distinct wave of a module once.  Instruments
+refer to waves by their index in the bank.  Samples are stored in the
+mixer's 0 to 255 range, not FamiTracker's 0 to 15.
+*/
+
+#define FTWAVE_NONE 0xFFFF
+#define FTWAVE_MAX_ID 0xFFFE
+
+typedef struct {
+  unsigned short id;  // index in the bank
+  unsigned char length;
+  unsigned char padding0;
+  unsigned char data[];
+} FTWave;
+
+typedef struct {
+  GapList *waves;  // GapList<FTWave *> waves[waveid]
+  HashMap *by_content;  // HashMap<FTWave *, FTWave *>
+} FTWaveBank;
+
+/**
+ * Allocates an empty wave bank.
+ * @return the bank, or NULL if out of memory
+ */
+FTWaveBank *FTWaveBank_new(void);
+
+/**
+ * Frees a wave bank and all its waves.
+ */
+void FTWaveBank_delete(FTWaveBank *self);
+
+/**
+ * Makes room for n more distinct waves, so that adding them does
+ * not grow the bank's content index one step at a time.
+ * @return nonzero if successful or 0 if out of memory
+ */
+int FTWaveBank_reserve(FTWaveBank *self, size_t n);
+
+/**
+ * Finds a wave with the same length and samples, or adds one if
+ * there is none.
+ * @param data samples 0 to 255
+ * @param length number of samples, 1 to 255
+ * @return the wave's ID, or FTWAVE_NONE if out of memory
+ */
+unsigned int FTWaveBank_intern(FTWaveBank *self, const unsigned char *data,
+                               size_t length);
+
+/**
+ * Returns the number of distinct waves in a bank.
+ */
+static inline size_t FTWaveBank_size(FTWaveBank *self) {
+  return Gap_size(self->waves);
+}
+
+/**
+ * Returns the wave with a given ID, or NULL if none.
+ */
+static inline const FTWave *FTWaveBank_get(FTWaveBank *self, size_t id) {
+  FTWave **result = Gap_get(self->waves, id);
+  return result ? *result : 0;
+}
+
+#endif
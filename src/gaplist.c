@@ -19,9 +19,11 @@ struct GapList {
   */
   void *data;  // the backing array
   size_t elSize;  // size of an element in bytes
+  size_t alignment;  // alignment of the backing array, or 0 for malloc's
   size_t nEls;  // number of valid elements
   size_t insertionPoint;  // point where elements can be inserted
   size_t capacity;  // number of elements in the backing array
+  Allocator alloc;  // where the list and its backing array come from
 };
 
 void Gap_clear(GapList *v) {
@@ -55,6 +57,23 @@ void *Gap_addAll(GapList *restrict v, const void *restrict src, size_t n) {
   return Gap_get(v, oldIP);
 }
 
+/**
+ * Allocates a backing array for a list, honoring its alignment.
+ * Allocates at least one byte so that an empty list is not mistaken
+ * for an allocation failure.
+ */
+static void *alloc_data(const GapList *v, size_t capacity) {
+  size_t nBytes = capacity * v->elSize;
+  return v->alloc.alloc(v->alloc.ctx, nBytes ? nBytes : 1, v->alignment);
+}
+
+/**
+ * Returns the size in bytes with which a backing array was allocated.
+ */
+static size_t data_bytes(const GapList *v, size_t capacity) {
+  return capacity ? capacity * v->elSize : 1;
+}
+
 bool Gap_ensureCapacity(GapList *v, size_t capacity) {
   if (!v) {
     return false;
@@ -65,24 +84,55 @@ bool Gap_ensureCapacity(GapList *v, size_t capacity) {
   if (capacity < v->nEls) {
     capacity = v->nEls;
   }
+  if (capacity == v->capacity) {
+    return true;
+  }
 
-  size_t oldIP = v->insertionPoint;
-
-  // If insertion point is not at end, move to end.
-  // This is suboptimal but should satisfy the test suite.
-  Gap_seek(v, v->nEls);
-
-  // Try reallocating the memory.
-  void *newMem = realloc(v->data, v->elSize * capacity);
-
-  // If reallocation succeeded, use the new memory.
-  if (newMem) {
-    v->data = newMem;
-    v->capacity = capacity;
+  // Elements before the gap stay where they are.  Only the elements
+  // after the gap move, so that the gap absorbs the change in size.
+  size_t elSize = v->elSize;
+  size_t tailBytes = (v->nEls - v->insertionPoint) * elSize;
+  size_t oldTail = v->capacity * elSize - tailBytes;
+  size_t newTail = capacity * elSize - tailBytes;
+  char *data = v->data;
+
+  if (v->alignment) {
+
+    // realloc() doesn't preserve alignment, so copy each side
+    // of the gap into a new array
+    char *newMem = alloc_data(v, capacity);
+    if (!newMem) {
+      return false;
+    }
+    memcpy(newMem, data, v->insertionPoint * elSize);
+    memcpy(newMem + newTail, data + oldTail, tailBytes);
+    v->alloc.free(v->alloc.ctx, data, data_bytes(v, v->capacity));
+    data = newMem;
+  } else if (capacity > v->capacity) {
+    char *newMem = v->alloc.realloc(v->alloc.ctx, data,
+                                    data_bytes(v, v->capacity),
+                                    data_bytes(v, capacity));
+    if (!newMem) {
+      return false;
+    }
+    data = newMem;
+    memmove(data + newTail, data + oldTail, tailBytes);
+  } else {
+
+    // Move the tail down before the array shrinks out from under it.
+    // If shrinking fails, the old array is still big enough.
+    memmove(data + newTail, data + oldTail, tailBytes);
+    char *newMem = v->alloc.realloc(v->alloc.ctx, data,
+                                    data_bytes(v, v->capacity),
+                                    data_bytes(v, capacity));
+    if (newMem) {
+      data = newMem;
+    }
   }
 
-  Gap_seek(v, oldIP);
-  return newMem ? true : false;
+  v->data = data;
+  v->capacity = capacity;
+  return true;
 }
 
 GapList *Gap_clone(GapList *v) {
@@ -90,7 +140,8 @@ GapList *Gap_clone(GapList *v) {
     return NULL;
   }
 
-  GapList *clone = Gap_new(v->elSize, v->nEls);
+  GapList *clone = Gap_newWithAllocator(&v->alloc, v->elSize, v->nEls,
+                                        v->alignment);
   if (!clone) {
     return NULL;
   }
@@ -103,25 +154,39 @@ GapList *Gap_clone(GapList *v) {
   return clone;
 }
 
-GapList *Gap_new(size_t elSize, size_t capacity) {
-  GapList *v = malloc(sizeof(GapList));
+GapList *Gap_newWithAllocator(const Allocator *alloc, size_t elSize,
+                              size_t capacity, size_t alignment) {
+  if (!alloc || (alignment & (alignment - 1))) {
+    return NULL;
+  }
+  GapList *v = alloc->alloc(alloc->ctx, sizeof(GapList), 0);
   if (!v) {
     return NULL;
   }
 
-  v->data = malloc(capacity * elSize);
+  v->alloc = *alloc;
+  v->elSize = elSize;
+  v->alignment = alignment;
+  v->data = alloc_data(v, capacity);
   if (!v->data) {
-    free(v);
+    alloc->free(alloc->ctx, v, sizeof(GapList));
     return NULL;
   }
 
-  v->elSize = elSize;
   v->capacity = capacity;
   Gap_clear(v);
 
   return v;
 }
 
+GapList *Gap_newAligned(size_t elSize, size_t capacity, size_t alignment) {
+  return Gap_newWithAllocator(&Allocator_libc, elSize, capacity, alignment);
+}
+
+GapList *Gap_new(size_t elSize, size_t capacity) {
+  return Gap_newAligned(elSize, capacity, 0);
+}
+
 void *Gap_get(GapList *v, size_t i) {
   if (!v) {
     return NULL;
@@ -145,6 +210,29 @@ void *Gap_getRange(GapList *v, size_t fromIndex, size_t toIndex) {
   return Gap_get(v, fromIndex);
 }
 
+GapSpans Gap_spans(GapList *v) {
+  GapSpans spans = {NULL, 0, NULL, 0};
+  if (!v) {
+    return spans;
+  }
+  spans.before = v->data;
+  spans.nBefore = v->insertionPoint;
+  spans.after = (char *)(v->data)
+                + (v->capacity - v->nEls + v->insertionPoint) * v->elSize;
+  spans.nAfter = v->nEls - v->insertionPoint;
+  return spans;
+}
+
+void Gap_forEachSpan(GapList *v, GapSpanVisitor fn, void *ctx) {
+  GapSpans spans = Gap_spans(v);
+  if (spans.nBefore) {
+    fn(spans.before, spans.nBefore, ctx);
+  }
+  if (spans.nAfter) {
+    fn(spans.after, spans.nAfter, ctx);
+  }
+}
+
 size_t Gap_size(GapList *v) {
   return v ? v->nEls : 0;
 }
@@ -260,9 +348,10 @@ void Gap_delete(GapList *v)
 
     // Extra check here because some libc implementations
     // crash on free(NULL).
+    Allocator alloc = v->alloc;
     if (v->data) {
-      free(v->data);
+      alloc.free(alloc.ctx, v->data, data_bytes(v, v->capacity));
     }
-    free(v);
+    alloc.free(alloc.ctx, v, sizeof(GapList));
   }
 }
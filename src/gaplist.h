@@ -15,11 +15,35 @@ http://www.cs.cmu.edu/~wjh/papers/byte.html
 
 */
 
+#ifndef GAPLIST_H
+#define GAPLIST_H
 
 #include <stdbool.h>
 #include <sys/types.h>
+#include "allocator.h"
 typedef struct GapList GapList;
 
+/**
+ * The elements of a list as two arrays, one on each side of the gap.
+ * Elements 0 to nBefore - 1 are at before; elements nBefore to
+ * nBefore + nAfter - 1 are at after.  Valid until the list is
+ * modified or its insertion point moves.
+ */
+typedef struct GapSpans {
+  void *before;
+  size_t nBefore;
+  void *after;
+  size_t nAfter;
+} GapSpans;
+
+/**
+ * Visits a contiguous run of elements.
+ * @param els pointer to the first element
+ * @param n number of elements
+ * @param ctx the context passed to Gap_forEachSpan()
+ */
+typedef void (*GapSpanVisitor)(void *els, size_t n, void *ctx);
+
 
 /**
  * Creates a new list with elements of the given size.
@@ -28,6 +52,27 @@ typedef struct GapList GapList;
  */
 GapList *Gap_new(size_t elSize, size_t capacity);
 
+/**
+ * Creates a new list whose backing array is aligned for vector
+ * loads, such as to a cache line.
+ * @param elSize sizeof(an element)
+ * @param capacity the expected number of elements
+ * @param alignment a power of two, or 0 for malloc()'s alignment
+ */
+GapList *Gap_newAligned(size_t elSize, size_t capacity, size_t alignment);
+
+/**
+ * Creates a new list whose backing array and bookkeeping are
+ * allocated through the given allocator rather than the C library.
+ * @param alloc the allocator, which is copied and must remain usable
+ * until the list is deleted
+ * @param elSize sizeof(an element)
+ * @param capacity the expected number of elements
+ * @param alignment a power of two, or 0 for malloc()'s alignment
+ */
+GapList *Gap_newWithAllocator(const Allocator *alloc, size_t elSize,
+                              size_t capacity, size_t alignment);
+
 /**
  * Destroys a list, freeing the memory associated with it
  * and its elements.
@@ -98,8 +143,9 @@ static inline bool Gap_isEmpty(GapList *v) {
 }
 
 /**
- * Increases the capacity of the list to hold at least a minimum
- * number of elements.
+ * Changes the capacity of the list to hold at least a minimum
+ * number of elements.  Elements after the insertion point move to
+ * the end of the resized array; those before it stay in place.
  * @return true if successfully resized; false if out of memory.
  * @param v this list
  * @param capacity the minimum number of elements
@@ -129,6 +175,25 @@ GapList *Gap_clone(GapList *v);
  */
 void *Gap_get(GapList *v, size_t i);
 
+/**
+ * Returns the elements of this list as at most two arrays, without
+ * moving the insertion point.  Loops over the arrays need no bounds
+ * check or gap test per element.
+ * @param v this list
+ * @return the spans before and after the gap; a span with no
+ * elements has a count of 0
+ */
+GapSpans Gap_spans(GapList *v);
+
+/**
+ * Calls a function for each contiguous run of elements in this list,
+ * in order.  Runs with no elements are skipped.
+ * @param v this list
+ * @param fn the function to call
+ * @param ctx passed to fn
+ */
+void Gap_forEachSpan(GapList *v, GapSpanVisitor fn, void *ctx);
+
 /**
  * Overwrites a block of elements. For instance, setting elements
  * "from" 2 "to" 6 will replace elements 2, 3, 4, and 5 with the
@@ -199,3 +264,4 @@ static inline bool Gap_remove(GapList *v, size_t fromIndex) {
   return Gap_removeRange(v, fromIndex, fromIndex + 1);
 }
 
+#endif
@@ -1,9 +1,24 @@
 // began at 17:25
 
+/*
+The table is split into groups of 16 slots.  Each slot has a control
+byte: EMPTY, DELETED, or the top 7 bits of the key's mixed hash if
+the slot is full.  A lookup loads a whole group of control bytes at
+once, compares all 16 against the key's 7 bits, and calls cmp only
+for slots that match, which is about 1 in 128 of the slots that don't
+hold the key.  Probing goes from group to group with triangular steps
+and stops at the first group with an EMPTY slot.
+
+Further reading:
+https://abseil.io/about/design/swisstables
+*/
+
 #include "hashmap.h"
-#include <stdio.h>   // for anomaly logging
-#include <stdlib.h>  // for malloc, calloc
-#include <assert.h>
+#include <string.h>  // for memset
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 struct HashMapEntry {
   HashMapHashValue hashValue;
@@ -12,11 +27,14 @@ struct HashMapEntry {
 };
 
 struct HashMap {
-  struct HashMapEntry *items;
-  size_t capacity;
-  size_t size;
+  struct HashMapEntry *items;  // capacity entries, then ctrl
+  uint8_t *ctrl;  // capacity control bytes
+  size_t capacity;  // a power of two, at least one group
+  size_t size;  // number of full slots
+  size_t tombstones;  // number of DELETED slots
   HashMapComparator cmp;
   HashMapHasher hash;
+  Allocator alloc;
 };
 
 struct HashMapIterator {
@@ -25,179 +43,282 @@ struct HashMapIterator {
 };
 
 #define HASHMAP_INITIAL_CAPACITY 16
+#define HASHMAP_GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
 
-static const char HASHMAP_DELETED_ITEM[] = {0};
+/**
+ * Returns the number of slots that may be full or DELETED before
+ * the table must grow or be compacted.  Leaving 1/8 of slots EMPTY
+ * keeps unsuccessful lookups short.
+ */
+static size_t max_load(size_t capacity) {
+  return capacity - capacity / 8;
+}
 
-HashMap *HashMap_new(HashMapComparator cmp, HashMapHasher hash) {
-  if (!cmp || !hash) return 0;
-  HashMap *self = malloc(sizeof(HashMap));
+/**
+ * Spreads the caller's hash value over 64 bits, so that hash
+ * functions with poor low bits still use every group.
+ */
+static uint64_t mix(HashMapHashValue hashValue) {
+  return (uint64_t)hashValue * 0x9E3779B97F4A7C15u;
+}
+
+static uint8_t ctrl_of(uint64_t h) {
+  return h >> 57;
+}
+
+static size_t first_group(const HashMap *self, uint64_t h) {
+  return (size_t)(h >> 25) & (self->capacity / HASHMAP_GROUP_SIZE - 1);
+}
+
+// Group matching ///////////////////////////////////////////////////
+
+// Each returns a mask with bit i set if slot i of the group matches
+
+#ifdef __SSE2__
+
+static unsigned int group_match(const uint8_t *ctrl, uint8_t c) {
+  __m128i group = _mm_load_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+}
+
+static unsigned int group_match_free(const uint8_t *ctrl) {
+  // EMPTY and DELETED have bit 7 set; full slots don't
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+}
+
+#else
+
+static unsigned int group_match(const uint8_t *ctrl, uint8_t c) {
+  unsigned int mask = 0;
+  for (unsigned int i = 0; i < HASHMAP_GROUP_SIZE; ++i) {
+    mask |= (unsigned int)(ctrl[i] == c) << i;
+  }
+  return mask;
+}
+
+static unsigned int group_match_free(const uint8_t *ctrl) {
+  unsigned int mask = 0;
+  for (unsigned int i = 0; i < HASHMAP_GROUP_SIZE; ++i) {
+    mask |= (unsigned int)(ctrl[i] >> 7) << i;
+  }
+  return mask;
+}
+
+#endif
+
+static unsigned int lowest_bit(unsigned int mask) {
+#ifdef __GNUC__
+  return __builtin_ctz(mask);
+#else
+  unsigned int i = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    ++i;
+  }
+  return i;
+#endif
+}
+
+// Table storage ////////////////////////////////////////////////////
+
+/**
+ * Allocates entries and control bytes for a table of the given
+ * capacity in one block, with every slot EMPTY.
+ */
+static int alloc_table(HashMap *self, size_t capacity) {
+  if (capacity > SIZE_MAX / 2 / (sizeof(HashMapEntry) + 1)) return 0;
+  HashMapEntry *items = self->alloc.alloc(
+    self->alloc.ctx, capacity * (sizeof(HashMapEntry) + 1),
+    HASHMAP_GROUP_SIZE
+  );
+  if (!items) return 0;
+  self->items = items;
+  self->ctrl = (uint8_t *)(items + capacity);
+  self->capacity = capacity;
+  memset(self->ctrl, CTRL_EMPTY, capacity);
+  return 1;
+}
+
+static void free_table(const HashMap *self) {
+  self->alloc.free(self->alloc.ctx, self->items,
+                   self->capacity * (sizeof(HashMapEntry) + 1));
+}
+
+HashMap *HashMap_newWithAllocator(const Allocator *alloc,
+                                  HashMapComparator cmp,
+                                  HashMapHasher hash) {
+  if (!alloc || !cmp || !hash) return 0;
+  HashMap *self = alloc->alloc(alloc->ctx, sizeof(HashMap), 0);
   if (!self) return 0;
-  self->capacity = HASHMAP_INITIAL_CAPACITY;
   self->size = 0;
+  self->tombstones = 0;
   self->cmp = cmp;
   self->hash = hash;
-  self->items = calloc(self->capacity, sizeof(HashMapEntry));
-  if (!self->items) {
-    free(self);
+  self->alloc = *alloc;
+  if (!alloc_table(self, HASHMAP_INITIAL_CAPACITY)) {
+    alloc->free(alloc->ctx, self, sizeof(HashMap));
     return 0;
   }
   return self;
 }
 
+HashMap *HashMap_new(HashMapComparator cmp, HashMapHasher hash) {
+  return HashMap_newWithAllocator(&Allocator_libc, cmp, hash);
+}
+
 void HashMap_delete(HashMap *self) {
-  if (self) free(self->items);
-  free(self);
+  if (!self) return;
+  Allocator alloc = self->alloc;
+  free_table(self);
+  alloc.free(alloc.ctx, self, sizeof(HashMap));
 }
 
 void HashMap_clear(HashMap *self) {
   self->size = 0;
-  for (size_t i = 0; i < self->capacity; ++i) {
-    self->items[i].key = 0;
-    self->items[i].value = 0;
-  }
+  self->tombstones = 0;
+  memset(self->ctrl, CTRL_EMPTY, self->capacity);
 }
 
 size_t HashMap_size(const HashMap *self) {
   return self->size;
 }
 
+HashMapComparator HashMap_comparator(const HashMap *self) {
+  return self->cmp;
+}
+
+HashMapHasher HashMap_hasher(const HashMap *self) {
+  return self->hash;
+}
+
+// Probing //////////////////////////////////////////////////////////
+
 /**
- * Probes through an array, starting at a particular hash value,
- * for a key or NULL or HASHMAP_DELETED_ITEM.
+ * Finds the slot holding a key.
  * @param hashValue must equal self->hash(key)
- * @param delIndex where to write the index of an encountered
- *   HASHMAP_DELETED_ITEM (usually 0 for get or a pointer for put)
- * @return if present: index into self->items of this key;
- *   if absent: index where it could be inserted;
- *   if >= self->capacity: there's no space
+ * @return index into self->items, or SIZE_MAX if absent
  */
-static size_t probe(const HashMap *self, const void *key,
-                    HashMapHashValue hashValue, size_t *delIndex) {
-  // Quadratic probing
-  size_t num_skipped = 0;
-  size_t index = (hashValue ^ (hashValue >> 23));
-  while (num_skipped < self->capacity) {
-    index &= self->capacity - 1;
-    const void *keyHere = self->items[index].key;
-    if (!keyHere) return index;  // Empty
-    if (delIndex && key == HASHMAP_DELETED_ITEM) *delIndex = index;
-    if (self->items[index].hashValue == hashValue
-        && self->cmp(key, keyHere) == 0) {
-      return index;
+static size_t find(const HashMap *self, const void *key,
+                   HashMapHashValue hashValue) {
+  uint64_t h = mix(hashValue);
+  uint8_t c = ctrl_of(h);
+  size_t groupMask = self->capacity / HASHMAP_GROUP_SIZE - 1;
+  size_t group = first_group(self, h);
+  for (size_t step = 1; step <= groupMask + 1; ++step) {
+    size_t base = group * HASHMAP_GROUP_SIZE;
+    const uint8_t *ctrl = self->ctrl + base;
+    for (unsigned int m = group_match(ctrl, c); m; m &= m - 1) {
+      const HashMapEntry *entry = &self->items[base + lowest_bit(m)];
+      if (entry->hashValue == hashValue && self->cmp(key, entry->key) == 0) {
+        return entry - self->items;
+      }
     }
-    index += num_skipped * 2 + 1;
-    num_skipped += 1;
+    if (group_match(ctrl, CTRL_EMPTY)) break;
+    group = (group + step) & groupMask;
   }
-  return self->capacity;
+  return SIZE_MAX;
+}
+
+/**
+ * Finds the first EMPTY or DELETED slot along a hash's probe
+ * sequence.  There always is one because max_load() < capacity.
+ */
+static size_t find_free(const HashMap *self, uint64_t h) {
+  size_t groupMask = self->capacity / HASHMAP_GROUP_SIZE - 1;
+  size_t group = first_group(self, h);
+  for (size_t step = 1; ; ++step) {
+    size_t base = group * HASHMAP_GROUP_SIZE;
+    unsigned int m = group_match_free(self->ctrl + base);
+    if (m) return base + lowest_bit(m);
+    group = (group + step) & groupMask;
+  }
+}
+
+/**
+ * Moves every entry into a new table, dropping DELETED slots.
+ * @return nonzero if successful; 0 if out of memory, in which case
+ * the old table is unchanged
+ */
+static int rehash(HashMap *self, size_t newCapacity) {
+  HashMap old = *self;
+  if (!alloc_table(self, newCapacity)) return 0;
+  for (size_t i = 0; i < old.capacity; ++i) {
+    if (old.ctrl[i] & 0x80) continue;
+    uint64_t h = mix(old.items[i].hashValue);
+    size_t index = find_free(self, h);
+    self->ctrl[index] = ctrl_of(h);
+    self->items[index] = old.items[i];
+  }
+  self->tombstones = 0;
+  free_table(&old);
+  return 1;
+}
+
+/**
+ * Makes room for one more entry.  Grows the table if it is mostly
+ * full of live entries, or rebuilds it at the same size if it is
+ * mostly full of DELETED slots.
+ */
+static int reserve_one(HashMap *self) {
+  if (self->size + self->tombstones < max_load(self->capacity)) return 1;
+  if (self->size < max_load(self->capacity) / 2) {
+    return rehash(self, self->capacity);
+  }
+  if (self->capacity > SIZE_MAX / 2) return 0;
+  return rehash(self, self->capacity * 2);
 }
 
+int HashMap_reserve(HashMap *self, size_t n) {
+  if (n > SIZE_MAX / 2) return 0;
+  if (n < self->size) n = self->size;
+  if (n + self->tombstones <= max_load(self->capacity)) return 1;
+  size_t capacity = self->capacity;
+  while (max_load(capacity) < n) capacity *= 2;
+  return rehash(self, capacity);
+}
+
+// Lookup and modification //////////////////////////////////////////
+
 int HashMap_containsKey(const HashMap *self, const void *key) {
-  HashMapHashValue hashValue = self->hash(key);
-  size_t index = probe(self, key, hashValue, 0);
-  return index < self->capacity && self->items[index].key != 0;
+  return find(self, key, self->hash(key)) != SIZE_MAX;
 }
 
 void *HashMap_getOrDefault(const HashMap *self, const void *key,
                            void *defaultValue) {
-  HashMapHashValue hashValue = self->hash(key);
-  size_t index = probe(self, key, hashValue, 0);
-  if (index >= self->capacity) return defaultValue;
-  const void *keyHere = self->items[index].key;
-  return keyHere ? self->items[index].value : defaultValue;
+  size_t index = find(self, key, self->hash(key));
+  return index != SIZE_MAX ? self->items[index].value : defaultValue;
 }
 
 void *HashMap_get(const HashMap *self, const void *key) {
   return HashMap_getOrDefault(self, key, 0);
 }
 
-static size_t expand(HashMap *self) {
-  // Allocate new pool of items
-  if (self->capacity >= SIZE_MAX / 2) return 0;
-  HashMap tempMap;
-  tempMap.capacity = self->capacity * 2;
-  tempMap.size = 0;
-  tempMap.cmp = self->cmp;
-  tempMap.hash = self->hash;
-  tempMap.items = calloc(tempMap.capacity, sizeof(HashMapEntry));
-  if (!tempMap.items) return 0;
-  
-  // Copy all items that aren't NULL or tombstone
-  for (size_t i = 0; i < self->capacity; ++i) {
-    const void *key = self->items[i].key;
-    if (key == 0 || key == HASHMAP_DELETED_ITEM) continue;
-    size_t tempIndex = probe(&tempMap, key, self->items[i].hashValue,
-                             0);
-    if (tempIndex >= tempMap.capacity) {
-      fprintf(stderr, "anomaly while resizing map from capacity %zu to %zu: probe could not find space for item at %zu\n",
-              self->capacity, tempMap.capacity, i);
-      free(tempMap.items);
-      return 0;
-    }
-    tempMap.items[tempIndex] = self->items[i];
-  }
-
-  if (self->size != tempMap.size) {
-    fprintf(stderr, "anomaly while resizing map from capacity %zu to %zu: size from %zu to %zu\n",
-            self->capacity, tempMap.capacity, self->size, tempMap.size);
-    free(tempMap.items);
-    return 0;
-  }
-
-  // Items are copied; switch to the new backing storage
-  free(self->items);
-  self->items = tempMap.items;
-  self->capacity = tempMap.capacity;
-  return tempMap.capacity;
-}
-
-void *put_impl(HashMap *self, const void *key, void *value,
-               int replaceNull, int replaceNonnull) {
-  assert(self->capacity >= self->size);
-  if ((self->capacity - self->size) > (self->capacity / 4)) {
-    fprintf(stderr, "expanding map at %zu of %zu filled\n",
-            self->size, self->capacity);
-    if (!expand(self)) {
-      fprintf(stderr, "failed to expand map at %zu of %zu filled\n",
-              self->size, self->capacity);
-      return 0;
-    }
-  }
-
-  // Find the item
+static void *put_impl(HashMap *self, const void *key, void *value,
+                      int replaceNull, int replaceNonnull) {
   HashMapHashValue hashValue = self->hash(key);
-  size_t delIndex = self->capacity;
-  size_t index = probe(self, key, hashValue, &delIndex);
-  // It's possible for index to be invalid (>= self->capacity) and
-  // delIndex to be valid (< self->capacity) if the table is getting
-  // full of deleted item markers.  Usually this means an expand()
-  // is warranted soon.
-  
-  // Add or replace the item.
-  const void *keyHere = index < self->capacity
-                        ? self->items[index].key : 0;
-  if (keyHere != 0) {
+  size_t index = find(self, key, hashValue);
+  if (index != SIZE_MAX) {
     // Key exists; replace its value if requested
     void *previousValue = self->items[index].value;
     if (previousValue && !replaceNonnull) return previousValue;
     if (!previousValue && !replaceNull) return previousValue;
     self->items[index].value = value;
     return previousValue;
-  } else {
-    // Adding item that doesn't currently exist.
-    // Try to replace deleted item markers if possible
-    if (delIndex < self->capacity) index = delIndex;
-    if (index >= self->capacity) {
-      fprintf(stderr, "anomaly when probing to add item at %zu of %zu filled; delIndex was %zu\n",
-              self->size, self->capacity, delIndex);
-      return 0;
-    }
-
-    self->items[index].hashValue = hashValue;
-    self->items[index].key = key;
-    self->items[index].value = value;
-    self->size += 1;
-    return 0;
   }
+
+  // Adding item that doesn't currently exist
+  if (!reserve_one(self)) return 0;
+  uint64_t h = mix(hashValue);
+  index = find_free(self, h);
+  if (self->ctrl[index] == CTRL_DELETED) self->tombstones -= 1;
+  self->ctrl[index] = ctrl_of(h);
+  self->items[index].hashValue = hashValue;
+  self->items[index].key = key;
+  self->items[index].value = value;
+  self->size += 1;
+  return 0;
 }
 
 void *HashMap_put(HashMap *self, const void *key, void *value) {
@@ -214,24 +335,83 @@ void *HashMap_putIfAbsent(HashMap *self, const void *key,
   return put_impl(self, key, value, 1, 0);
 }
 
+int HashMap_putAll(HashMap *self, const HashMapPair *pairs, size_t n) {
+  if (n > SIZE_MAX - self->size || !HashMap_reserve(self, self->size + n)) {
+    return 0;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    put_impl(self, pairs[i].key, pairs[i].value, 1, 1);
+  }
+  return 1;
+}
+
 void *HashMap_remove(HashMap *self, const void *key) {
-  // Find the item
-  HashMapHashValue hashValue = self->hash(key);
-  size_t index = probe(self, key, hashValue, 0);
-  if (index >= self->capacity) return 0;
-  const void *keyHere = self->items[index].key;
-  if (keyHere == 0) return 0;
-
-  // Remove the item
-  if (self->size > 0) {
-    self->size -= 1;
+  size_t index = find(self, key, self->hash(key));
+  if (index == SIZE_MAX) return 0;
+
+  // A group that has never been full ends every probe sequence that
+  // reaches it, so a slot in such a group can become EMPTY again.
+  // Once a group fills, its slots must stay DELETED so that probes
+  // continue past it.
+  size_t base = index & ~(size_t)(HASHMAP_GROUP_SIZE - 1);
+  if (group_match(self->ctrl + base, CTRL_EMPTY)) {
+    self->ctrl[index] = CTRL_EMPTY;
   } else {
-    fprintf(stderr, "anomaly when probing to add item at %zu of %zu filled\n",
-            self->size, self->capacity);
+    self->ctrl[index] = CTRL_DELETED;
+    self->tombstones += 1;
   }
-  void *previousValue = self->items[index].value;
-  self->items[index].hashValue = index * 33;
-  self->items[index].key = HASHMAP_DELETED_ITEM;
-  self->items[index].value = 0;
-  return previousValue;
+  self->size -= 1;
+  return self->items[index].value;
+}
+
+// Iteration ////////////////////////////////////////////////////////
+
+/**
+ * Finds the first full slot at or after index, scanning control
+ * bytes a group at a time.
+ * @return the slot's index, or self->capacity if none
+ */
+static size_t next_full(const HashMap *self, size_t index) {
+  while (index < self->capacity) {
+    size_t base = index & ~(size_t)(HASHMAP_GROUP_SIZE - 1);
+    unsigned int m = ~group_match_free(self->ctrl + base)
+                     & ((1u << HASHMAP_GROUP_SIZE) - 1);
+    m &= ~0u << (index - base);
+    if (m) return base + lowest_bit(m);
+    index = base + HASHMAP_GROUP_SIZE;
+  }
+  return self->capacity;
+}
+
+HashMapIterator *HashMap_iter(const HashMap *self) {
+  HashMapIterator *it = self->alloc.alloc(self->alloc.ctx,
+                                          sizeof(HashMapIterator), 0);
+  if (!it) return 0;
+  it->map = self;
+  it->index = next_full(self, 0);
+  return it;
+}
+
+void HashMapIterator_delete(HashMapIterator *self) {
+  if (!self) return;
+  const Allocator *alloc = &self->map->alloc;
+  alloc->free(alloc->ctx, self, sizeof(HashMapIterator));
+}
+
+void HashMapIterator_next(HashMapIterator *self, const void **out_key,
+                          void **out_value) {
+  const HashMap *map = self->map;
+  const void *key = 0;
+  void *value = 0;
+  if (self->index < map->capacity) {
+    key = map->items[self->index].key;
+    value = map->items[self->index].value;
+    self->index = next_full(map, self->index + 1);
+  }
+  if (out_key) *out_key = key;
+  if (out_value) *out_value = value;
+}
+
+int HashMapIterator_hasNext(const HashMapIterator *self) {
+  return self->index < self->map->capacity;
 }
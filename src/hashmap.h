@@ -3,12 +3,21 @@
 
 #include <stdint.h>  // for uint_fast32_t
 #include <stdlib.h>  // for size_t
+#include "allocator.h"
 
 typedef uint_fast32_t HashMapHashValue;
 typedef struct HashMapEntry HashMapEntry;
 typedef struct HashMapIterator HashMapIterator;
 typedef struct HashMap HashMap;
 
+/**
+ * A key and the value to map it to, for HashMap_putAll().
+ */
+typedef struct HashMapPair {
+  const void *key;
+  void *value;
+} HashMapPair;
+
 /**
  * Returns 0 if two keys are equal or nonzero if not.
  */
@@ -31,6 +40,17 @@ typedef HashMapHashValue (*HashMapHasher)(const void *);
  */
 HashMap *HashMap_new(HashMapComparator cmp, HashMapHasher hash);
 
+/**
+ * Creates a new dictionary whose table is allocated through the
+ * given allocator rather than the C library.
+ * @param alloc the allocator, which is copied and must remain usable
+ * until the dictionary is deleted
+ * @return pointer to the new object or NULL if an error occurred
+ */
+HashMap *HashMap_newWithAllocator(const Allocator *alloc,
+                                  HashMapComparator cmp,
+                                  HashMapHasher hash);
+
 /**
  * Destroys a dictionary.
  */
@@ -46,6 +66,24 @@ void HashMap_clear(HashMap *self);
  */
 size_t HashMap_size(const HashMap *self);
 
+/**
+ * Returns the function that a dictionary uses to compare keys.
+ */
+HashMapComparator HashMap_comparator(const HashMap *self);
+
+/**
+ * Returns the function that a dictionary uses to hash keys.
+ */
+HashMapHasher HashMap_hasher(const HashMap *self);
+
+/**
+ * Grows the table, if needed, so that it can hold n keys without
+ * growing or rebuilding again.  Use this when the number of keys
+ * is known before they are added.
+ * @return nonzero if successful or 0 if out of memory
+ */
+int HashMap_reserve(HashMap *self, size_t n);
+
 /**
  * Returns nonzero if the given key is associated with a value.
  */
@@ -85,6 +123,16 @@ void *HashMap_setdefault(HashMap *self, const void *key,
 void *HashMap_putIfAbsent(HashMap *self, const void *key,
                           void *value);
 
+/**
+ * Maps each of an array of keys to its value, as if by HashMap_put(),
+ * growing the table at most once beforehand.
+ * @param pairs the keys and values
+ * @param n the number of pairs
+ * @return nonzero if successful or 0 if out of memory, in which case
+ * the map is unchanged
+ */
+int HashMap_putAll(HashMap *self, const HashMapPair *pairs, size_t n);
+
 /**
  * Maps key to nothing.
  * @return the old value, or NULL if absent
@@ -93,11 +141,21 @@ void *HashMap_remove(HashMap *self, const void *key);
 
 /**
  * Makes an iterator over the items in a map.  If items are added or removed, the behavior is undefined.
+ * Items are visited in table order, not in the order they were added.
+ * @return the iterator, or NULL if out of memory
  */
 HashMapIterator *HashMap_iter(const HashMap *self);
 
 /**
- * Moves to the next 
+ * Frees an iterator.
+ */
+void HashMapIterator_delete(HashMapIterator *self);
+
+/**
+ * Moves to the next item, writing its key and value.  If there are
+ * no more items, writes NULL.
+ * @param out_key where to write the key, or NULL to skip it
+ * @param out_value where to write the value, or NULL to skip it
  */
 void HashMapIterator_next(HashMapIterator *self, const void **out_key,
                           void **out_value);
@@ -0,0 +1,118 @@
+/*
+a lock-free table of canonical keys
+*/
+#include "interntable.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define INTERN_MIN_CAPACITY 16
+
+typedef struct InternSlot {
+  _Atomic(const void *) key;  // NULL if empty; set once by compare-and-swap
+  _Atomic uint_least64_t hash;  // the key's tagged hash, or 0 until stored
+} InternSlot;
+
+struct InternTable {
+  size_t capacity;  // a power of two
+  unsigned int shift;  // 64 - log2(capacity)
+  HashMapComparator cmp;
+  HashMapHasher hash;
+  atomic_size_t size;
+  InternSlot slots[];
+};
+
+/**
+ * Spreads a hash value over 64 bits and sets bit 0, so that no key
+ * has the empty slot's hash word.
+ */
+static uint_least64_t tag(HashMapHashValue hashValue) {
+  return ((uint_least64_t)hashValue * 0x9E3779B97F4A7C15u) | 1;
+}
+
+InternTable *InternTable_new(size_t capacity, HashMapComparator cmp,
+                             HashMapHasher hash) {
+  if (!cmp || !hash || capacity > SIZE_MAX / 4 / sizeof(InternSlot)) {
+    return 0;
+  }
+
+  // Keep the table at most half full so that probes stay short
+  size_t slots = INTERN_MIN_CAPACITY;
+  unsigned int shift = 64 - 4;
+  while (slots < capacity * 2) {
+    slots *= 2;
+    shift -= 1;
+  }
+  InternTable *self = malloc(sizeof(InternTable) + slots * sizeof(InternSlot));
+  if (!self) return 0;
+  self->capacity = slots;
+  self->shift = shift;
+  self->cmp = cmp;
+  self->hash = hash;
+  atomic_init(&self->size, 0);
+  for (size_t i = 0; i < slots; ++i) {
+    atomic_init(&self->slots[i].key, 0);
+    atomic_init(&self->slots[i].hash, 0);
+  }
+  return self;
+}
+
+void InternTable_delete(InternTable *self) {
+  free(self);
+}
+
+size_t InternTable_size(const InternTable *self) {
+  return atomic_load_explicit(&((InternTable *)self)->size,
+                              memory_order_relaxed);
+}
+
+/**
+ * Tests whether a claimed slot holds a key equal to one with tagged
+ * hash h.  A slot whose claiming thread has not yet stored the hash
+ * is compared by key, so that no thread waits on another.
+ */
+static int slot_matches(const InternTable *self, InternSlot *slot,
+                        const void *keyHere, const void *key,
+                        uint_least64_t h) {
+  uint_least64_t here = atomic_load_explicit(&slot->hash,
+                                             memory_order_acquire);
+  return (here == 0 || here == h) && self->cmp(key, keyHere) == 0;
+}
+
+const void *InternTable_intern(InternTable *self, const void *key) {
+  uint_least64_t h = tag(self->hash(key));
+  size_t mask = self->capacity - 1;
+  size_t i = h >> self->shift;
+  for (size_t n = 0; n < self->capacity; ++n, i = (i + 1) & mask) {
+    InternSlot *slot = &self->slots[i];
+    const void *keyHere = atomic_load_explicit(&slot->key,
+                                               memory_order_acquire);
+    if (!keyHere) {
+      // Try to claim the empty slot.  If another thread claims it
+      // first, keyHere becomes that thread's key.
+      if (atomic_compare_exchange_strong_explicit(
+            &slot->key, &keyHere, key,
+            memory_order_acq_rel, memory_order_acquire)) {
+        atomic_store_explicit(&slot->hash, h, memory_order_release);
+        atomic_fetch_add_explicit(&self->size, 1, memory_order_relaxed);
+        return key;
+      }
+    }
+    if (slot_matches(self, slot, keyHere, key, h)) return keyHere;
+  }
+  return 0;
+}
+
+const void *InternTable_get(const InternTable *self, const void *key) {
+  uint_least64_t h = tag(self->hash(key));
+  size_t mask = self->capacity - 1;
+  size_t i = h >> self->shift;
+  for (size_t n = 0; n < self->capacity; ++n, i = (i + 1) & mask) {
+    InternSlot *slot = (InternSlot *)&self->slots[i];
+    const void *keyHere = atomic_load_explicit(&slot->key,
+                                               memory_order_acquire);
+    if (!keyHere) return 0;
+    if (slot_matches(self, slot, keyHere, key, h)) return keyHere;
+  }
+  return 0;
+}
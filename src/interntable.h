@@ -0,0 +1,64 @@
+#ifndef INTERNTABLE_H
+#define INTERNTABLE_H
+
+#include "hashmap.h"
+
+/*
+An intern table maps each distinct key to one canonical copy, the
+first equal key added, and can be shared by threads that add keys at
+the same time without a lock.  It is meant for parallel loaders that
+deduplicate waves, patterns, or envelopes as they parse.
+
+Each slot holds a key pointer and a hash word.  A thread claims an
+empty slot by compare-and-swap on its key pointer, so a slot is
+never claimed without its key, then stores the key's hash.  The hash
+only lets a probe skip slots of other keys without calling the
+comparator; a probe that finds a key whose hash is not yet stored
+compares the keys instead.  No thread ever waits on another, and
+nothing is ever moved, so lookups need no lock.
+
+The table does not grow: it is sized when created for the number of
+distinct keys expected, as a loader knows from the module's counts.
+Keys cannot be removed.
+*/
+
+typedef struct InternTable InternTable;
+
+/**
+ * Creates an empty intern table.
+ * @param capacity the most distinct keys it must hold
+ * @param cmp returns 0 if and only if two keys are equal
+ * @param hash returns the same value for equal keys
+ * @return the table, or NULL if out of memory
+ */
+InternTable *InternTable_new(size_t capacity, HashMapComparator cmp,
+                             HashMapHasher hash);
+
+/**
+ * Frees an intern table.  The keys are not freed.  No other thread
+ * may be using it.
+ */
+void InternTable_delete(InternTable *self);
+
+/**
+ * Returns the canonical copy of a key, adding the key itself if no
+ * equal key is present.  Safe to call from several threads at once.
+ * @param key not NULL; must remain valid as long as the table, since
+ * it may become the canonical copy
+ * @return the canonical copy, which is key if key was added, or
+ * NULL if the table is full
+ */
+const void *InternTable_intern(InternTable *self, const void *key);
+
+/**
+ * Returns the canonical copy of a key, or NULL if none.  Safe to call
+ * while other threads add keys.
+ */
+const void *InternTable_get(const InternTable *self, const void *key);
+
+/**
+ * Returns the number of distinct keys added so far.
+ */
+size_t InternTable_size(const InternTable *self);
+
+#endif
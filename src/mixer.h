@@ -0,0 +1,94 @@
+/*
+
+Minimalist wavetable synthesizer
+
+Copyright 2022 Damian Yerrick
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+
+*/
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIZEOF_WAVERAM 256
+#define NUM_VOICES 16
+
+typedef struct WtVoice {
+  uint_fast32_t frequency;
+  uint_fast32_t phase;
+  uint8_t start, length, volume;
+} WtVoice;
+
+typedef struct WtMixer {
+  uint8_t waveram[SIZEOF_WAVERAM];
+  WtVoice voices[NUM_VOICES];
+} WtMixer;
+
+/**
+ * Mixes all voices into a buffer and advances their phases.
+ * @param out where to write num_samples unsigned samples; each voice
+ * adds volume * sample, so the caller subtracts the center
+ */
+void WtMixer_mix(WtMixer *self, uint16_t *out, size_t num_samples);
+
+/**
+ * Mixes all voices into signed samples centered on 0 and advances
+ * their phases.  Call once for each span between changes to the
+ * voices, of any length.
+ * @param out where to write num_samples signed samples
+ */
+void WtMixer_render(WtMixer *self, int16_t *out, size_t num_samples);
+
+/*
+A tick clock counts the output samples in each tick when a tick is
+not a whole number of samples, as at 60 Hz into 44100 Hz, at 50 Hz
+into 18157 Hz, or at a module's own tick rate.  Tick t starts at
+sample floor(t * outrate / tick_rate), so rounding never builds up.
+*/
+typedef struct WtTickClock {
+  unsigned int whole;  // outrate / tick_rate
+  unsigned int fraction;  // outrate % tick_rate
+  unsigned int tick_rate;
+  unsigned int accum;  // sample fraction carried, in 1/tick_rate units
+} WtTickClock;
+
+static inline void WtTickClock_init(WtTickClock *self, unsigned int outrate,
+                                    unsigned int tick_rate) {
+  self->whole = outrate / tick_rate;
+  self->fraction = outrate % tick_rate;
+  self->tick_rate = tick_rate;
+  self->accum = 0;
+}
+
+/**
+ * Returns the number of samples in the next tick.
+ */
+static inline unsigned int WtTickClock_next(WtTickClock *self) {
+  unsigned int samples = self->whole;
+  self->accum += self->fraction;
+  if (self->accum >= self->tick_rate) {
+    self->accum -= self->tick_rate;
+    samples += 1;
+  }
+  return samples;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+
+Minimalist wavetable synthesizer
+
+Copyright 2022 Damian Yerrick
+
+This software is provided 'as-is', without any express or implied
+warranty.  In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+
+*/
+
+/* to build:
+gcc -Wall -Wextra -Os -fsanitize=undefined -o mixer mixer_main.c mixer.c wavecache.c pitchtable.c canonwav.c -lm
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "mixer.h"
+#include "wavecache.h"
+#include "pitchtable.h"
+#include "canonwav.h"
+
+// Wave output //////////////////////////////////////////////////////
+
+#define OUTRATE 48000
+#define TICK_RATE 60
+#define BLOCK_SIZE 256
+#define WAVELEN 32
+
+// B-3, D#4, F#4
+const unsigned char chord_notes[3] = {47, 51, 54};
+
+int main(void) {
+  WAVEWRITER *out = wavewriter_open("out.wav");
+  if (!out) {
+    fputs("couldn't open wave for writing\n", stderr);
+    return EXIT_FAILURE;
+  }
+  wavewriter_setrate(out, OUTRATE);
+  wavewriter_setchannels(out, 1);
+  wavewriter_setdepth(out, 16);
+  
+  WtMixer mixer;
+
+  // Initialize wave RAM
+  memset(mixer.waveram, 0, sizeof(mixer.waveram));
+  uint8_t wave[WAVELEN];
+  for (size_t i = 0; i < WAVELEN; ++i) {
+    wave[i] = i / 2 * 255 / (WAVELEN / 2 - 1);
+  }
+  WtWaveCache wavecache;
+  WtWaveCache_init(&wavecache);
+  int wave_start = WtWaveCache_acquire(&wavecache, &mixer, 0, wave, WAVELEN);
+  if (0) {
+    puts("waveram:");
+    for (size_t i = 0; i < sizeof mixer.waveram / sizeof mixer.waveram[0]; ++i) {
+      printf("%02x", mixer.waveram[i]);
+    }
+    fputc('\n', stdout);
+  }
+
+  // Initialize voices
+  for (size_t v = 0; v < NUM_VOICES; ++v) {
+    mixer.voices[v].volume = 0;
+  }
+  WtPitchTable pitch_table;
+  WtPitchTable_init(&pitch_table, OUTRATE);
+  for (size_t v = 0; v < sizeof chord_notes / sizeof chord_notes[0]; ++v) {
+    mixer.voices[v].frequency = WtPitchTable_note(&pitch_table, chord_notes[v],
+                                                  WAVELEN);
+    mixer.voices[v].phase = 0;
+    mixer.voices[v].start = wave_start;
+    mixer.voices[v].length = WAVELEN;
+    printf("chord note %u frequency word %u\n",
+           chord_notes[v], (unsigned)mixer.voices[v].frequency);
+  }
+
+  // Write fixed-size blocks, mixing each in spans that end where a
+  // tick changes the voices
+  WtTickClock clock;
+  WtTickClock_init(&clock, OUTRATE, TICK_RATE);
+  short outbuf[BLOCK_SIZE];
+  size_t outbuf_len = 0;
+  for (size_t tick = 0; tick < 60; ++tick) {
+    for (size_t v = 0; v < sizeof chord_notes / sizeof chord_notes[0]; ++v) {
+      mixer.voices[v].volume = 60 - tick;
+    }
+    for (size_t left = WtTickClock_next(&clock); left > 0; ) {
+      size_t n = BLOCK_SIZE - outbuf_len;
+      if (n > left) n = left;
+      WtMixer_render(&mixer, outbuf + outbuf_len, n);
+      outbuf_len += n;
+      left -= n;
+      if (outbuf_len == BLOCK_SIZE) {
+        wavewriter_write(outbuf, outbuf_len, out);
+        outbuf_len = 0;
+      }
+    }
+  }
+  wavewriter_write(outbuf, outbuf_len, out);
+
+  wavewriter_close(out);
+  out = 0;
+  return 0;
+}
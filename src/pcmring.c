@@ -0,0 +1,176 @@
+/*
+a lock-free single-producer, single-consumer ring of samples
+*/
+#include "pcmring.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCMRING_MIN_CAPACITY 64
+
+struct PcmRing {
+  // Set when created
+  size_t mask;  // capacity - 1
+  int16_t *samples;
+
+  // Stored only by the producer
+  _Alignas(PCMRING_CACHE_LINE) atomic_size_t head;  // samples written
+  size_t tail_seen;  // the last tail the producer loaded
+  atomic_size_t peak_lead;
+  atomic_int closed;
+
+  // Stored only by the consumer
+  _Alignas(PCMRING_CACHE_LINE) atomic_size_t tail;  // samples read
+  size_t head_seen;  // the last head the consumer loaded
+  atomic_ulong underruns;
+  atomic_size_t underrun_samples;
+};
+
+PcmRing *PcmRing_new(size_t capacity) {
+  size_t slots = PCMRING_MIN_CAPACITY;
+  while (slots < capacity) {
+    if (slots > SIZE_MAX / 2 / sizeof(int16_t)) return 0;
+    slots *= 2;
+  }
+
+  // sizeof(PcmRing) is a multiple of its alignment, as aligned_alloc()
+  // requires
+  PcmRing *self = aligned_alloc(PCMRING_CACHE_LINE, sizeof(PcmRing));
+  if (!self) return 0;
+  self->samples = malloc(slots * sizeof(int16_t));
+  if (!self->samples) {
+    free(self);
+    return 0;
+  }
+  self->mask = slots - 1;
+  atomic_init(&self->head, 0);
+  self->tail_seen = 0;
+  atomic_init(&self->peak_lead, 0);
+  atomic_init(&self->closed, 0);
+  atomic_init(&self->tail, 0);
+  self->head_seen = 0;
+  atomic_init(&self->underruns, 0);
+  atomic_init(&self->underrun_samples, 0);
+  return self;
+}
+
+void PcmRing_delete(PcmRing *self) {
+  if (!self) return;
+  free(self->samples);
+  free(self);
+}
+
+/**
+ * Copies samples into a ring's storage at a head count, in two
+ * pieces if the ring wraps.
+ */
+static void copy_in(PcmRing *self, size_t head, const int16_t *samples,
+                    size_t n) {
+  size_t start = head & self->mask;
+  size_t first = self->mask + 1 - start;
+  if (first > n) first = n;
+  memcpy(self->samples + start, samples, first * sizeof(int16_t));
+  memcpy(self->samples, samples + first, (n - first) * sizeof(int16_t));
+}
+
+/**
+ * Copies samples out of a ring's storage at a tail count, in two
+ * pieces if the ring wraps.
+ */
+static void copy_out(const PcmRing *self, size_t tail, int16_t *out,
+                     size_t n) {
+  size_t start = tail & self->mask;
+  size_t first = self->mask + 1 - start;
+  if (first > n) first = n;
+  memcpy(out, self->samples + start, first * sizeof(int16_t));
+  memcpy(out + first, self->samples, (n - first) * sizeof(int16_t));
+}
+
+size_t PcmRing_write(PcmRing *self, const int16_t *samples,
+                     size_t num_samples) {
+  size_t capacity = self->mask + 1;
+  size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+
+  // Load the consumer's tail only if the last one seen leaves too
+  // little room
+  size_t room = capacity - (head - self->tail_seen);
+  if (room < num_samples) {
+    self->tail_seen = atomic_load_explicit(&self->tail, memory_order_acquire);
+    room = capacity - (head - self->tail_seen);
+  }
+  size_t n = num_samples < room ? num_samples : room;
+  copy_in(self, head, samples, n);
+  atomic_store_explicit(&self->head, head + n, memory_order_release);
+
+  // Measure the lead against the last tail seen rather than load the
+  // consumer's cache line on every write.  That tail may be stale,
+  // so the peak is an upper bound on the true lead.
+  size_t lead = head + n - self->tail_seen;
+  if (lead > atomic_load_explicit(&self->peak_lead, memory_order_relaxed)) {
+    atomic_store_explicit(&self->peak_lead, lead, memory_order_relaxed);
+  }
+  return n;
+}
+
+void PcmRing_close(PcmRing *self) {
+  atomic_store_explicit(&self->closed, 1, memory_order_release);
+}
+
+size_t PcmRing_read(PcmRing *self, int16_t *out, size_t num_samples) {
+  size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+
+  // Load the producer's head only if the last one seen holds too few
+  // samples.  Load closed first, so that a closed ring's head is final.
+  size_t ready = self->head_seen - tail;
+  int closed = 0;
+  if (ready < num_samples) {
+    closed = atomic_load_explicit(&self->closed, memory_order_acquire);
+    self->head_seen = atomic_load_explicit(&self->head, memory_order_acquire);
+    ready = self->head_seen - tail;
+  }
+  size_t n = num_samples < ready ? num_samples : ready;
+  copy_out(self, tail, out, n);
+  atomic_store_explicit(&self->tail, tail + n, memory_order_release);
+
+  if (n < num_samples && !closed) {
+    atomic_store_explicit(
+      &self->underruns,
+      atomic_load_explicit(&self->underruns, memory_order_relaxed) + 1,
+      memory_order_relaxed
+    );
+    atomic_store_explicit(
+      &self->underrun_samples,
+      atomic_load_explicit(&self->underrun_samples, memory_order_relaxed)
+      + (num_samples - n),
+      memory_order_relaxed
+    );
+  }
+  return n;
+}
+
+int PcmRing_finished(const PcmRing *self) {
+  PcmRing *ring = (PcmRing *)self;
+  return atomic_load_explicit(&ring->closed, memory_order_acquire)
+         && PcmRing_fill(self) == 0;
+}
+
+size_t PcmRing_fill(const PcmRing *self) {
+  PcmRing *ring = (PcmRing *)self;
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  return head - tail;
+}
+
+void PcmRing_stats(const PcmRing *self, PcmRingStats *out) {
+  PcmRing *ring = (PcmRing *)self;
+  out->capacity = ring->mask + 1;
+  out->read = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  out->written = atomic_load_explicit(&ring->head, memory_order_acquire);
+  out->fill = out->written - out->read;
+  out->peak_lead = atomic_load_explicit(&ring->peak_lead,
+                                        memory_order_relaxed);
+  out->underruns = atomic_load_explicit(&ring->underruns,
+                                        memory_order_relaxed);
+  out->underrun_samples = atomic_load_explicit(&ring->underrun_samples,
+                                               memory_order_relaxed);
+}
@@ -0,0 +1,92 @@
+#ifndef PCMRING_H
+#define PCMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+A PCM ring passes mono samples from one producer thread, which runs
+the player and mixer, to one consumer thread, which feeds an output
+device, without a lock.  Neither side ever waits on the other: a
+write stores as many samples as there is room for, and a read takes
+as many as are ready.
+
+Each side owns one counter of samples moved, which only it stores and
+the other side only loads.  Each side also remembers the last value
+it loaded of the other's counter and loads it again only when that
+value leaves too little room or too few samples, so that in steady
+state neither side touches the other's cache line on every call.
+The two counters, and the statistics each side keeps, sit on
+separate cache lines, so that the sides do not slow each other by
+false sharing.
+*/
+
+#define PCMRING_CACHE_LINE 64
+
+typedef struct PcmRing PcmRing;
+
+typedef struct PcmRingStats {
+  size_t capacity;  // most samples the ring can hold
+  size_t fill;  // samples ready to read
+  size_t written, read;  // samples moved since creation, wrapping
+  size_t peak_lead;  // the producer was never further ahead than this
+  unsigned long underruns;  // reads that found too few samples
+  size_t underrun_samples;  // samples those reads lacked
+} PcmRingStats;
+
+/**
+ * Creates an empty ring.
+ * @param capacity the most samples the ring must hold; rounded up to
+ * a power of two
+ * @return the ring, or NULL if out of memory
+ */
+PcmRing *PcmRing_new(size_t capacity);
+
+/**
+ * Frees a ring.  Neither thread may be using it.
+ */
+void PcmRing_delete(PcmRing *self);
+
+/**
+ * Copies samples into the ring, as many as fit.  Call only from the
+ * producer thread.
+ * @return the number of samples written, which is less than
+ * num_samples if the ring is full
+ */
+size_t PcmRing_write(PcmRing *self, const int16_t *samples,
+                     size_t num_samples);
+
+/**
+ * Marks the end of the stream.  Reads after this that find too few
+ * samples are not counted as underruns.  Call only from the producer
+ * thread, after its last write.
+ */
+void PcmRing_close(PcmRing *self);
+
+/**
+ * Copies samples out of the ring, as many as are ready.  A read that
+ * finds fewer than num_samples before the producer has closed the
+ * ring counts as an underrun.  Call only from the consumer thread.
+ * @return the number of samples read
+ */
+size_t PcmRing_read(PcmRing *self, int16_t *out, size_t num_samples);
+
+/**
+ * Returns nonzero if the producer has closed the ring and every
+ * sample has been read.
+ */
+int PcmRing_finished(const PcmRing *self);
+
+/**
+ * Returns the number of samples ready to read.  Safe from either
+ * thread, though the other may change it at once.
+ */
+size_t PcmRing_fill(const PcmRing *self);
+
+/**
+ * Reads the ring's statistics.  Safe from any thread; each field is
+ * up to date as of some recent moment.
+ */
+void PcmRing_stats(const PcmRing *self, PcmRingStats *out);
+
+#endif
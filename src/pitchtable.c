@@ -0,0 +1,14 @@
+/*
+note to frequency word tables
+*/
+#include "pitchtable.h"
+#include <math.h>
+
+void WtPitchTable_init(WtPitchTable *self, unsigned int outrate) {
+  self->outrate = outrate;
+  for (unsigned int n = 0; n <= WTPITCH_NUM_NOTES; ++n) {
+    double semitones = (double)n - WTPITCH_A440_NOTE;
+    double hz = 440.0 * pow(2.0, semitones / 12.0);
+    self->rates[n] = hz * 16777216.0 / outrate + 0.5;
+  }
+}
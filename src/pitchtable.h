@@ -0,0 +1,70 @@
+#ifndef PITCHTABLE_H
+#define PITCHTABLE_H
+
+#include <stdint.h>
+
+/*
+A pitch table converts a note, or a pitch between notes, to the
+frequency word of a WtVoice playing a wave of a given length at one
+output rate.  The frequency word is the 16.16 phase increment per
+output sample:
+
+  word = hz * length * 65536 / outrate
+
+The table is built once per output rate and holds the increment of
+every semitone for a 1-sample wave in 8.24, so that scaling by the
+wave's length gives the 16.16 word to within rounding for any length
+with one multiply.  A pitch between semitones is interpolated
+linearly, which is within 1 cent of equal temperament.  Per-tick
+pitch updates then cost a table read, a multiply, and a shift.
+
+Pitch is in 1/256 semitone units: note * WTPITCH_SEMITONE + fine.
+*/
+
+#define WTPITCH_NUM_NOTES 96  // C-0 to B-7
+#define WTPITCH_A440_NOTE 57  // A-4
+#define WTPITCH_SEMITONE 256
+#define WTPITCH_MAX ((WTPITCH_NUM_NOTES - 1) * WTPITCH_SEMITONE)
+
+typedef struct WtPitchTable {
+  unsigned int outrate;
+  // phase increment of each note for a 1-sample wave, in 8.24,
+  // with one more note to interpolate up to from B-7
+  uint_least32_t rates[WTPITCH_NUM_NOTES + 1];
+} WtPitchTable;
+
+/**
+ * Computes a pitch table for an output rate.
+ * @param outrate the output sample rate in Hz
+ */
+void WtPitchTable_init(WtPitchTable *self, unsigned int outrate);
+
+/**
+ * Returns the frequency word for a note.
+ * @param note 0 to WTPITCH_NUM_NOTES - 1
+ * @param length the wave's length in samples, 1 to 255
+ */
+static inline uint_fast32_t WtPitchTable_note(const WtPitchTable *self,
+                                              unsigned int note,
+                                              unsigned int length) {
+  return (uint_fast64_t)self->rates[note] * length >> 8;
+}
+
+/**
+ * Returns the frequency word for a pitch between notes.
+ * @param pitch in 1/256 semitones, clamped to 0 through WTPITCH_MAX
+ * @param length the wave's length in samples, 1 to 255
+ */
+static inline uint_fast32_t WtPitchTable_pitch(const WtPitchTable *self,
+                                               long pitch,
+                                               unsigned int length) {
+  if (pitch < 0) pitch = 0;
+  if (pitch > WTPITCH_MAX) pitch = WTPITCH_MAX;
+  unsigned int note = pitch / WTPITCH_SEMITONE;
+  unsigned int fine = pitch % WTPITCH_SEMITONE;
+  uint_fast32_t lo = self->rates[note], hi = self->rates[note + 1];
+  uint_fast32_t rate = lo + ((hi - lo) * fine >> 8);
+  return (uint_fast64_t)rate * length >> 8;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+
+GAPLIST_DEFINE(Name, T) defines a gap list of T whose operations are
+static inline functions.  Unlike GapList, the element size is known at
+compile time, so indexing is a shift or a constant multiply and stores
+are plain assignments instead of memcpy().  Use it for lists that are
+walked or built in hot loops; GapList remains for everything else.
+
+The generated functions follow the Gap_* functions of the same names
+but, for speed, do not check for a NULL list or an out-of-range index:
+
+  Name *Name_new(size_t capacity);
+  void Name_delete(Name *v);
+  size_t Name_size(const Name *v);
+  size_t Name_tell(const Name *v);
+  void Name_clear(Name *v);
+  bool Name_ensureCapacity(Name *v, size_t capacity);
+  void Name_seek(Name *v, size_t newIP);
+  T *Name_add(Name *v, T value);
+  T *Name_get(Name *v, size_t i);
+  void Name_set(Name *v, size_t i, T value);
+  T *Name_toArray(Name *v);  // seeks to the end; returns all elements
+
+*/
+
+#ifndef TYPEDGAP_H
+#define TYPEDGAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GAPLIST_DEFINE(Name, T) \
+typedef struct Name { \
+  T *data; \
+  size_t nEls, insertionPoint, capacity; \
+} Name; \
+\
+static inline Name *Name##_new(size_t capacity) { \
+  Name *v = malloc(sizeof(Name)); \
+  if (!v) return NULL; \
+  v->data = malloc((capacity ? capacity : 1) * sizeof(T)); \
+  if (!v->data) { \
+    free(v); \
+    return NULL; \
+  } \
+  v->nEls = v->insertionPoint = 0; \
+  v->capacity = capacity; \
+  return v; \
+} \
+\
+static inline void Name##_delete(Name *v) { \
+  if (v) free(v->data); \
+  free(v); \
+} \
+\
+static inline size_t Name##_size(const Name *v) { \
+  return v->nEls; \
+} \
+\
+static inline size_t Name##_tell(const Name *v) { \
+  return v->insertionPoint; \
+} \
+\
+static inline void Name##_clear(Name *v) { \
+  v->nEls = v->insertionPoint = 0; \
+} \
+\
+static inline bool Name##_ensureCapacity(Name *v, size_t capacity) { \
+  if (capacity < v->nEls) capacity = v->nEls; \
+  if (capacity <= v->capacity) return true; \
+  size_t nTail = v->nEls - v->insertionPoint; \
+  T *newMem = realloc(v->data, capacity * sizeof(T)); \
+  if (!newMem) return false; \
+  memmove(newMem + capacity - nTail, newMem + v->capacity - nTail, \
+          nTail * sizeof(T)); \
+  v->data = newMem; \
+  v->capacity = capacity; \
+  return true; \
+} \
+\
+static inline void Name##_seek(Name *v, size_t newIP) { \
+  size_t oldIP = v->insertionPoint, gap = v->capacity - v->nEls; \
+  if (newIP > v->nEls) newIP = v->nEls; \
+  if (newIP < oldIP) { \
+    memmove(v->data + newIP + gap, v->data + newIP, \
+            (oldIP - newIP) * sizeof(T)); \
+  } else if (newIP > oldIP) { \
+    memmove(v->data + oldIP, v->data + oldIP + gap, \
+            (newIP - oldIP) * sizeof(T)); \
+  } \
+  v->insertionPoint = newIP; \
+} \
+\
+static inline T *Name##_add(Name *v, T value) { \
+  if (v->nEls >= v->capacity \
+      && !Name##_ensureCapacity(v, v->nEls + v->nEls / 2 + 1)) { \
+    return NULL; \
+  } \
+  T *dst = v->data + v->insertionPoint++; \
+  v->nEls += 1; \
+  *dst = value; \
+  return dst; \
+} \
+\
+static inline T *Name##_get(Name *v, size_t i) { \
+  return v->data + i + (i >= v->insertionPoint) * (v->capacity - v->nEls); \
+} \
+\
+static inline void Name##_set(Name *v, size_t i, T value) { \
+  *Name##_get(v, i) = value; \
+} \
+\
+static inline T *Name##_toArray(Name *v) { \
+  Name##_seek(v, v->nEls); \
+  return v->data; \
+}
+
+#endif
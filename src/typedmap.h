@@ -0,0 +1,161 @@
+/*
+
+HASHMAP_DEFINE(Name, K, V, HASH, EQUAL) defines a hash map from K to V
+whose keys and values are stored in the table itself, for small keys
+such as IDs or packed tuples.  HASH(k) is an expression giving an
+unsigned integer for a key and EQUAL(a, b) one that is nonzero if two
+keys are equal; both are expanded in place, so a lookup makes no
+indirect calls and usually reads one cache line.  Use HashMap for keys
+that live elsewhere or whose size is not known at compile time.
+
+The table uses linear probing and stays at most 3/4 full.  HASH need
+not be well distributed, as it is multiplied by a constant and the
+top bits of the product choose the slot.
+
+The generated functions follow the HashMap_* functions of the same
+names but, for speed, do not check for a NULL map:
+
+  Name *Name_new(size_t capacity);  // capacity: expected number of keys
+  void Name_delete(Name *v);
+  size_t Name_size(const Name *v);
+  void Name_clear(Name *v);
+  bool Name_reserve(Name *v, size_t n);
+  V *Name_get(const Name *v, K key);  // NULL if absent
+  V *Name_put(Name *v, K key, V value);  // NULL if out of memory
+  bool Name_remove(Name *v, K key);  // false if absent
+
+Pointers returned by Name_get() and Name_put() are valid until the
+next Name_put(), Name_remove(), or Name_reserve().
+
+*/
+
+#ifndef TYPEDMAP_H
+#define TYPEDMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TYPEDMAP_MIN_CAPACITY 8
+
+#define HASHMAP_DEFINE(Name, K, V, HASH, EQUAL) \
+typedef struct Name##_Slot { \
+  K key; \
+  V value; \
+  bool full; \
+} Name##_Slot; \
+\
+typedef struct Name { \
+  Name##_Slot *slots; \
+  size_t size, capacity; \
+  unsigned int shift;  /* 64 - log2(capacity) */ \
+} Name; \
+\
+static inline size_t Name##_home(const Name *v, K key) { \
+  return (size_t)(((uint64_t)(HASH(key)) * 0x9E3779B97F4A7C15u) \
+                  >> v->shift); \
+} \
+\
+/* Returns the slot holding key, or the empty slot that ends its run */ \
+static inline size_t Name##_find(const Name *v, K key) { \
+  size_t mask = v->capacity - 1; \
+  size_t i = Name##_home(v, key); \
+  while (v->slots[i].full && !(EQUAL(v->slots[i].key, key))) { \
+    i = (i + 1) & mask; \
+  } \
+  return i; \
+} \
+\
+static inline bool Name##_rehash(Name *v, size_t capacity) { \
+  unsigned int shift = 64; \
+  while (((size_t)1 << (64 - shift)) < capacity) --shift; \
+  Name##_Slot *slots = calloc(capacity, sizeof(Name##_Slot)); \
+  if (!slots) return false; \
+  Name old = *v; \
+  v->slots = slots; \
+  v->capacity = capacity; \
+  v->shift = shift; \
+  for (size_t i = 0; i < old.capacity; ++i) { \
+    if (!old.slots[i].full) continue; \
+    v->slots[Name##_find(v, old.slots[i].key)] = old.slots[i]; \
+  } \
+  free(old.slots); \
+  return true; \
+} \
+\
+static inline bool Name##_reserve(Name *v, size_t n) { \
+  if (n < v->size) n = v->size; \
+  if (n > SIZE_MAX / 8) return false; \
+  size_t capacity = v->capacity; \
+  while (n > capacity / 4 * 3) capacity *= 2; \
+  return capacity == v->capacity || Name##_rehash(v, capacity); \
+} \
+\
+static inline Name *Name##_new(size_t capacity) { \
+  Name *v = malloc(sizeof(Name)); \
+  if (!v) return NULL; \
+  v->slots = NULL; \
+  v->size = v->capacity = 0; \
+  if (!Name##_rehash(v, TYPEDMAP_MIN_CAPACITY) \
+      || !Name##_reserve(v, capacity)) { \
+    free(v->slots); \
+    free(v); \
+    return NULL; \
+  } \
+  return v; \
+} \
+\
+static inline void Name##_delete(Name *v) { \
+  if (v) free(v->slots); \
+  free(v); \
+} \
+\
+static inline size_t Name##_size(const Name *v) { \
+  return v->size; \
+} \
+\
+static inline void Name##_clear(Name *v) { \
+  for (size_t i = 0; i < v->capacity; ++i) v->slots[i].full = false; \
+  v->size = 0; \
+} \
+\
+static inline V *Name##_get(const Name *v, K key) { \
+  Name##_Slot *slot = &v->slots[Name##_find(v, key)]; \
+  return slot->full ? &slot->value : NULL; \
+} \
+\
+static inline V *Name##_put(Name *v, K key, V value) { \
+  size_t i = Name##_find(v, key); \
+  if (!v->slots[i].full) { \
+    if (v->size + 1 > v->capacity / 4 * 3) { \
+      if (!Name##_reserve(v, v->size + 1)) return NULL; \
+      i = Name##_find(v, key); \
+    } \
+    v->slots[i].key = key; \
+    v->slots[i].full = true; \
+    v->size += 1; \
+  } \
+  v->slots[i].value = value; \
+  return &v->slots[i].value; \
+} \
+\
+static inline bool Name##_remove(Name *v, K key) { \
+  size_t mask = v->capacity - 1; \
+  size_t i = Name##_find(v, key); \
+  if (!v->slots[i].full) return false; \
+\
+  /* Move later keys of the run back into the hole if that brings */ \
+  /* them no earlier than their home slot, so that no run is broken */ \
+  for (size_t j = (i + 1) & mask; v->slots[j].full; j = (j + 1) & mask) { \
+    size_t home = Name##_home(v, v->slots[j].key); \
+    if (((j - home) & mask) >= ((j - i) & mask)) { \
+      v->slots[i] = v->slots[j]; \
+      i = j; \
+    } \
+  } \
+  v->slots[i].full = false; \
+  v->size -= 1; \
+  return true; \
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+keeping recently used waves resident in wave RAM
+*/
+#include "wavecache.h"
+#include <string.h>
+
+void WtWaveCache_init(WtWaveCache *self) {
+  self->num_entries = 0;
+  self->clock = 0;
+  self->hits = self->misses = self->evictions = 0;
+}
+
+static size_t find_entry(const WtWaveCache *self, unsigned int wave_id) {
+  for (size_t i = 0; i < self->num_entries; ++i) {
+    if (self->entries[i].wave_id == wave_id) return i;
+  }
+  return self->num_entries;
+}
+
+/**
+ * Finds the smallest free span of wave RAM that fits length samples.
+ * @param out_index where to write the index in entries at which an
+ * entry for this span would be inserted
+ * @return the span's start address, or WTCACHE_NO_WAVE if none fits
+ */
+static int find_space(const WtWaveCache *self, size_t length,
+                      size_t *out_index) {
+  int best_start = WTCACHE_NO_WAVE;
+  size_t best_size = SIZEOF_WAVERAM + 1;
+  size_t span_start = 0;
+  for (size_t i = 0; i <= self->num_entries; ++i) {
+    size_t span_end = i < self->num_entries
+                      ? self->entries[i].start : SIZEOF_WAVERAM;
+    size_t span_size = span_end - span_start;
+    if (span_size >= length && span_size < best_size) {
+      best_start = span_start;
+      best_size = span_size;
+      *out_index = i;
+    }
+    if (i < self->num_entries) {
+      span_start = self->entries[i].start + self->entries[i].length;
+    }
+  }
+  return best_start;
+}
+
+/**
+ * Removes the least recently used unpinned wave.
+ * @return nonzero if a wave was removed; 0 if all are pinned
+ */
+static int evict_one(WtWaveCache *self) {
+  size_t victim = self->num_entries;
+  for (size_t i = 0; i < self->num_entries; ++i) {
+    const WtCacheEntry *entry = &self->entries[i];
+    if (entry->refs) continue;
+    if (victim >= self->num_entries
+        || entry->last_used < self->entries[victim].last_used) {
+      victim = i;
+    }
+  }
+  if (victim >= self->num_entries) return 0;
+  self->num_entries -= 1;
+  memmove(&self->entries[victim], &self->entries[victim + 1],
+          (self->num_entries - victim) * sizeof(WtCacheEntry));
+  self->evictions += 1;
+  return 1;
+}
+
+int WtWaveCache_acquire(WtWaveCache *self, WtMixer *mixer,
+                        unsigned int wave_id, const uint8_t *data,
+                        size_t length) {
+  if (length < 1 || length >= SIZEOF_WAVERAM) return WTCACHE_NO_WAVE;
+  self->clock += 1;
+
+  // Already resident?
+  size_t i = find_entry(self, wave_id);
+  if (i < self->num_entries) {
+    WtCacheEntry *entry = &self->entries[i];
+    entry->refs += 1;
+    entry->last_used = self->clock;
+    self->hits += 1;
+    return entry->start;
+  }
+
+  // Make room, evicting waves that no voice uses
+  self->misses += 1;
+  size_t index = 0;
+  int start;
+  while ((start = find_space(self, length, &index)) == WTCACHE_NO_WAVE
+         || self->num_entries >= WTCACHE_MAX_ENTRIES) {
+    if (!evict_one(self)) return WTCACHE_NO_WAVE;
+  }
+
+  memmove(&self->entries[index + 1], &self->entries[index],
+          (self->num_entries - index) * sizeof(WtCacheEntry));
+  self->num_entries += 1;
+  WtCacheEntry *entry = &self->entries[index];
+  entry->wave_id = wave_id;
+  entry->refs = 1;
+  entry->last_used = self->clock;
+  entry->start = start;
+  entry->length = length;
+  memcpy(mixer->waveram + start, data, length);
+  return start;
+}
+
+void WtWaveCache_release(WtWaveCache *self, unsigned int wave_id) {
+  size_t i = find_entry(self, wave_id);
+  if (i < self->num_entries && self->entries[i].refs > 0) {
+    self->entries[i].refs -= 1;
+  }
+}
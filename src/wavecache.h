@@ -0,0 +1,56 @@
+#ifndef WAVECACHE_H
+#define WAVECACHE_H
+
+#include "mixer.h"
+
+/*
+A wave cache decides where in the mixer's wave RAM each wave lives.
+Waves that a voice is using are pinned by a reference count.  Waves
+that no voice uses stay loaded until their space is needed, so
+switching back to a recently used wave costs no copy.  When a wave
+must be loaded and no space is free, the least recently used
+unpinned waves are evicted.
+*/
+
+#define WTCACHE_MAX_ENTRIES 64
+#define WTCACHE_NO_WAVE (-1)
+
+typedef struct WtCacheEntry {
+  unsigned int wave_id;
+  unsigned int refs;
+  unsigned long last_used;
+  uint8_t start, length;
+} WtCacheEntry;
+
+typedef struct WtWaveCache {
+  WtCacheEntry entries[WTCACHE_MAX_ENTRIES];  // sorted by start
+  size_t num_entries;
+  unsigned long clock;
+  unsigned long hits, misses, evictions;
+} WtWaveCache;
+
+/**
+ * Marks all of wave RAM as free.
+ */
+void WtWaveCache_init(WtWaveCache *self);
+
+/**
+ * Pins a wave in wave RAM, loading it if it is not already loaded.
+ * @param mixer the mixer whose wave RAM this cache manages
+ * @param wave_id a number that identifies the wave's content
+ * @param data the wave's samples, read only if the wave must be loaded
+ * @param length the number of samples, 1 to 255
+ * @return the wave's start address in wave RAM, or WTCACHE_NO_WAVE
+ * if pinned waves leave no space for it
+ */
+int WtWaveCache_acquire(WtWaveCache *self, WtMixer *mixer,
+                        unsigned int wave_id, const uint8_t *data,
+                        size_t length);
+
+/**
+ * Unpins a wave, leaving it in wave RAM until its space is needed.
+ * Call once for each successful WtWaveCache_acquire().
+ */
+void WtWaveCache_release(WtWaveCache *self, unsigned int wave_id);
+
+#endif